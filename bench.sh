@@ -0,0 +1,196 @@
+#!/bin/sh
+#
+# bench.sh - how fast can dsp itself go?
+#
+# Runs dsp against `dsp --serve' on the loopback, first held to each of
+# BENCH_RATES (bytes per second for every connection) and then without
+# any limit, so that the only thing slowing the test down is the client.
+# For every run it shows the rate reached, the processor time dsp used
+# per GB received and what that comes to per call of its write callback.
+# The last run is the unlimited one again in the text format. Its
+# progress display is only drawn on a terminal, which the output here
+# never is, so it should cost no more than the JSON one.
+#
+# Usage: bench.sh [DSP]
+#
+# The environment can change what is run:
+#   BENCH_PORT      port of the loopback server (default 18080)
+#   BENCH_DURATION  seconds of every run (default 3)
+#   BENCH_STREAMS   streams of every run (default 1)
+#   BENCH_RATES     the limits to run at, with dsp's size suffixes
+#                   (default "64M 128M 256M 512M 1G 2G 4G")
+#
+
+DSP=${1:-./dsp}
+PORT=${BENCH_PORT:-18080}
+DURATION=${BENCH_DURATION:-3}
+STREAMS=${BENCH_STREAMS:-1}
+RATES=${BENCH_RATES:-"64M 128M 256M 512M 1G 2G 4G"}
+
+URL="http://127.0.0.1:$PORT/1024G"
+SERVER=
+SUSTAINED=
+FELL_SHORT=
+CEILING=
+CPU=
+TIMES=${TMPDIR:-/tmp}/dsp-bench.$$
+
+if ! test -x "$DSP"; then
+    echo "bench.sh: $DSP: not found (run \`make' first?)" >&2
+    exit 1
+fi
+
+stop_server() {
+    if test -n "$SERVER"; then
+        kill -INT "$SERVER" 2>/dev/null
+        wait "$SERVER" 2>/dev/null
+        SERVER=
+    fi
+}
+
+trap 'stop_server; rm -f "$TIMES"; exit 1' INT TERM
+
+# start_server [RATE]
+start_server() {
+    if test -n "$1"; then
+        "$DSP" --serve="127.0.0.1:$PORT" --serve-rate="$1" >/dev/null &
+    else
+        "$DSP" --serve="127.0.0.1:$PORT" >/dev/null &
+    fi
+    SERVER=$!
+    sleep 1
+    if ! kill -0 "$SERVER" 2>/dev/null; then
+        echo "bench.sh: could not serve on port $PORT" >&2
+        exit 1
+    fi
+}
+
+# the first number named NAME in a JSON object
+json_number() {
+    tr ',{' '\n\n' | sed -n "s/^\"$1\":\([0-9.]*\)[]}]*$/\1/p" | sed -n 1p
+}
+
+# the limit in bytes per second of a size like 512M
+rate_in_bytes() {
+    echo "$1" | awk '{
+        n = $1 + 0
+        u = toupper(substr($1, length($1)))
+        if (u == "K") n *= 1024
+        else if (u == "M") n *= 1048576
+        else if (u == "G") n *= 1073741824
+        printf "%.0f\n", n
+    }'
+}
+
+# sets CPU to the processor time, in seconds, used so far by the
+# finished children (`times' has to run in this shell, not in a $(...))
+children_cpu() {
+    times >"$TIMES"
+    CPU=$(sed -n 2p "$TIMES" | awk '{
+        t = 0
+        for (i = 1; i <= 2; ++i) {
+            split($i, a, "m")
+            sub("s", "", a[2])
+            t += (a[1] * 60) + a[2]
+        }
+        printf "%.3f\n", t
+    }')
+}
+
+# run_json LIMIT [RATE]
+run_json() {
+    start_server "$2"
+    out=$("$DSP" -u "$URL" --duration="$DURATION" --streams="$STREAMS" \
+        --format=json)
+    status=$?
+    stop_server
+    if test $status -ne 0; then
+        printf '%-10s  failed\n' "$1"
+        return
+    fi
+
+    rate=$(echo "$out" | json_number average_bytes_per_sec)
+    bytes=$(echo "$out" | json_number bytes)
+    cpu=$(echo "$out" | json_number cpu_ns)
+    calls=$(echo "$out" | json_number data_callbacks)
+    loop=$(echo "$out" | json_number housekeeping_ns)
+    limit=0
+    if test -n "$2"; then
+        limit=$(rate_in_bytes "$2")
+    fi
+
+    echo "$1 $rate $bytes ${cpu:-0} $calls $loop $limit $STREAMS" | awk '{
+        mib = $2 / 1048576
+        gb = $3 / 1000000000
+        pct = "-"
+        if ($7 > 0)
+            pct = sprintf("%.1f%%", ($2 * 100) / ($7 * $8))
+        cpu = ($4 > 0 && gb > 0) ? sprintf("%.3f", ($4 / 1e9) / gb) : "-"
+        call = ($4 > 0 && $5 > 0) ? sprintf("%.0f", $4 / $5) : "-"
+        size = ($5 > 0) ? sprintf("%.1f", ($3 / $5) / 1024) : "-"
+        loop = ($5 > 0) ? sprintf("%.3f", ($6 / 1e9) / gb) : "-"
+        printf "%-10s %10.1f %9s %10s %10s %9s %10s\n", $1, mib, pct,
+            cpu, call, size, loop
+    }'
+
+    if test -n "$2"; then
+        reached=$(echo "$rate $limit $STREAMS" | awk \
+            '{ print ($1 >= ($2 * $3 * 0.95)) ? "yes" : "no" }')
+        if test "$reached" = no; then
+            FELL_SHORT=yes
+        elif test -z "$FELL_SHORT"; then
+            SUSTAINED=$2
+        fi
+    else
+        CEILING=$rate
+    fi
+}
+
+# the unlimited run once more in text mode
+run_text() {
+    start_server
+    children_cpu
+    before=$CPU
+    out=$("$DSP" -u "$URL" --duration="$DURATION" --streams="$STREAMS" \
+        -B -nB)
+    status=$?
+    children_cpu
+    after=$CPU
+    stop_server
+    if test $status -ne 0; then
+        printf '%-10s  failed\n' text
+        return
+    fi
+
+    out=$(echo "$out" | tr '\r' '\n')
+    rate=$(echo "$out" | sed -n 's/^Average d\/l rate: *\([0-9]*\).*/\1/p')
+    bytes=$(echo "$out" | sed -n 's/^Total d\/l size: *\([0-9]*\).*/\1/p')
+    echo "$rate $bytes $before $after" | awk '{
+        gb = $2 / 1000000000
+        cpu = (gb > 0) ? sprintf("%.3f", ($4 - $3) / gb) : "-"
+        printf "%-10s %10.1f %9s %10s %10s %9s %10s\n", "text",
+            $1 / 1048576, "-", cpu, "-", "-", "-"
+    }'
+}
+
+echo "dsp loopback benchmark: $STREAMS stream(s), $DURATION s per run"
+echo
+printf '%-10s %10s %9s %10s %10s %9s %10s\n' limit "MiB/s" "of limit" \
+    "CPU s/GB" "ns/call" "KiB/call" "loop s/GB"
+for r in $RATES; do
+    run_json "$r/s" "$r"
+done
+run_json none
+run_text
+
+echo
+if test -n "$SUSTAINED"; then
+    echo "Sustained:  every limit up to $SUSTAINED/s per stream"
+else
+    echo "Sustained:  none of the limits"
+fi
+if test -n "$CEILING"; then
+    echo "$CEILING" | awk '{ printf "Ceiling:    %.1f MiB/s\n", $1 / 1048576 }'
+fi
+rm -f "$TIMES"
+exit 0
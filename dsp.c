@@ -22,16 +22,50 @@
 # include "config.h"
 #endif
 
+#include <ctype.h>
 #include <errno.h>
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
 #include <limits.h>
+#include <math.h>
+#ifdef HAVE_NETDB_H
+# include <netdb.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+# include <netinet/in.h>
+#endif
+#ifdef HAVE_NETINET_TCP_H
+# include <netinet/tcp.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+#include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_SYS_SOCKET_H
+# include <sys/socket.h>
+#endif
 #include <sys/stat.h>
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 # include <sys/ioctl.h>
 #endif
+#ifdef HAVE_SYS_RESOURCE_H
+# include <sys/resource.h>
+#endif
 #include <time.h>
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -39,9 +73,40 @@
 #ifdef HAVE_WINDOWS_H
 # include <windows.h>
 #endif
+/* --hash uses SSE4.2 and the SHA extensions where the processor has them */
+#if defined(HAVE_CPUID_H) && defined(HAVE_IMMINTRIN_H) && \
+    defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define DSP_HAVE_X86_HASH 1
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
 
 #include <curl/curl.h>
 
+/* --latency needs threads, --metrics also needs BSD sockets */
+#ifdef HAVE_PTHREAD_H
+# define DSP_HAVE_THREADS 1
+#endif
+#if defined(DSP_HAVE_THREADS) && defined(HAVE_NETDB_H) && \
+    defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_TIME_H) && \
+    defined(HAVE_SYS_UIO_H) && defined(HAVE_UNISTD_H)
+# define DSP_HAVE_SOCKETS 1
+#endif
+/* --rcvbuf, --nodelay and --congestion set options of libcurl's sockets */
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_NETINET_IN_H) && \
+    defined(HAVE_NETINET_TCP_H)
+# define DSP_HAVE_SOCKET_OPTIONS 1
+#endif
+/* --save writes the file from a thread of its own with pwrite() */
+#if defined(DSP_HAVE_THREADS) && defined(HAVE_FCNTL_H) && \
+    defined(HAVE_UNISTD_H) && defined(HAVE_POSIX_MEMALIGN)
+# define DSP_HAVE_SAVE 1
+#endif
+/* --segmented --keep writes every range into one file with pwrite() */
+#if defined(HAVE_PWRITE) && defined(HAVE_FCNTL_H) && defined(HAVE_UNISTD_H)
+# define DSP_HAVE_RANGE_FILE 1
+#endif
+
 #define DSP_DEFAULT_PROGRAM_NAME "dsp"
 
 #define DSP_VERSION "1.3.0"
@@ -71,6 +136,98 @@
 "  -L, --large            Perform test using a large size download (82MB)\n" \
 "                         Slowest test but with most accurate results\n" \
 "  -u URL, --url=URL      Perform test with URL instead of the default\n" \
+"  -k, --keep             Write the downloaded data to a temporary file\n" \
+"                         instead of discarding it in memory\n" \
+"  --streams=N            Download over N connections at the same time\n" \
+"                         (1 to 64, default is 1)\n" \
+"  --auto[=PCT]           Stop the test as soon as the 95% confidence\n" \
+"                         interval of the rate is within PCT percent of\n" \
+"                         its mean (default is 2)\n" \
+"  --duration=SECONDS     Stop the test after SECONDS and show the results\n" \
+"                         of that time, however big the file is\n" \
+"  --interval=MS          Sample the progress of the test every MS\n" \
+"                         milliseconds (1 to 60000, default is 100)\n" \
+"  --format=FORMAT        Show the results as FORMAT, which can be `text'\n" \
+"                         (the default), `json' or `csv'\n" \
+"  --live                 Write a line of JSON with the progress of the\n" \
+"                         test every `--interval' instead of the progress\n" \
+"                         display (implies `--format=json')\n" \
+"  --latency[=MS]         Also measure the round-trip time to the server\n" \
+"                         before and (every MS milliseconds, default is\n" \
+"                         200) during the test\n" \
+"  --histogram            Also show how the sampled download rates are\n" \
+"                         spread over rates that double in size\n" \
+"  --warmup=SECONDS       Leave out the first SECONDS of the test from\n" \
+"                         the steady-state rate instead of finding the\n" \
+"                         end of the warm-up automatically\n" \
+"  --segmented            Split the file into byte ranges that are\n" \
+"                         downloaded over the `--streams' connections\n" \
+"                         (4 unless `--streams' is given)\n" \
+"  --daemon[=SECONDS]     Keep running and start a test about every\n" \
+"                         SECONDS (default is 300) until interrupted\n" \
+"  --metrics=[ADDR:]PORT  With `--daemon', serve the results of the tests\n" \
+"                         for Prometheus on PORT of ADDR (127.0.0.1 if\n" \
+"                         not given)\n" \
+"  --upload[=SIZE]        Upload SIZE bytes (a K, M or G suffix multiplies\n"\
+"                         by 1024, 1024^2 or 1024^3, default is 40M) of\n" \
+"                         generated data to `--url' over each stream\n" \
+"                         instead of downloading; with `--duration' and\n"\
+"                         no SIZE it uploads until the time is up\n" \
+"  --post                 With `--upload', use POST instead of PUT\n" \
+"  --mirrors[=LIST]       Send a HEAD request for the test file to each of\n"\
+"                         the comma-separated GNU mirror URLs in LIST (a\n" \
+"                         built-in list if not given) at once and test\n" \
+"                         with the one that connects the fastest\n" \
+"  --sources=K            With `--mirrors', spread the streams over the\n" \
+"                         K fastest mirrors\n" \
+"  --duplex[=URL]         Download, then upload to URL (or `--url') for\n"\
+"                         as long, then do both at once and show how much\n"\
+"                         each direction slowed down\n" \
+"  --serve=[ADDR:]PORT    Instead of testing, answer tests on PORT of ADDR\n"\
+"                         (all addresses if not given) until interrupted:\n"\
+"                         GET /SIZE sends SIZE (default 40M) bytes, PUT\n" \
+"                         and POST bodies are thrown away\n" \
+"  --serve-rate=RATE      With `--serve', send and receive at most RATE\n" \
+"                         bytes (with a K, M or G suffix) per second on\n" \
+"                         each connection\n" \
+"  --serve-delay=MS       With `--serve', wait MS milliseconds before\n" \
+"                         answering each request\n" \
+"  --buffer-size=SIZE     Have libcurl read into a buffer of SIZE bytes\n" \
+"                         (1K to 10M, older versions of libcurl use at\n" \
+"                         most 512K)\n" \
+"  --rcvbuf=SIZE          Set the receive buffer (SO_RCVBUF) of every\n" \
+"                         connection to SIZE bytes, 0 leaves it to the\n" \
+"                         system\n" \
+"  --nodelay[=on|off]     Turn TCP_NODELAY on (libcurl's default) or off\n"\
+"  --congestion=NAME      Use the TCP congestion control algorithm NAME\n"\
+"                         (for example `cubic' or `bbr')\n" \
+"  --sweep                Run the test once for every combination of the\n"\
+"                         comma-separated values given to the four\n" \
+"                         options above and show the rates in a table\n" \
+"                         (with buffers of 16K,64K,256K,1M and receive\n" \
+"                         buffers of 0,256K,1M,4M if none are given)\n" \
+"  --http=VERSION         Speak VERSION of HTTP (1.1, 2 or 3); HTTP/2 is\n"\
+"                         asked for with an Upgrade over http:// URLs\n" \
+"  --multiplex            Carry all of the streams over one HTTP/2 (or\n" \
+"                         HTTP/3) connection instead of one each\n" \
+"  --compare-http[=N]     Run the test over HTTP/1.1, HTTP/2, HTTP/2 with\n"\
+"                         N (default 4) streams on one connection and\n" \
+"                         HTTP/3 in turn and show the rates and time to\n" \
+"                         the first byte of each in a table\n" \
+"  --repeat=N             Run the test N times over the same connections\n"\
+"                         and show the mean, median and 95% confidence\n" \
+"                         interval of the rates and the time to the\n" \
+"                         first byte\n" \
+"  --fresh                With `--repeat' or `--daemon', make every test\n"\
+"                         look up the name and connect all over again\n" \
+"  --pause=SECONDS        With `--repeat', wait SECONDS between the runs\n"\
+"  --hash=ALGORITHM       Hash the file as it arrives with ALGORITHM\n" \
+"                         (`crc32c' or `sha256') and show its digest\n" \
+"  --expect=DIGEST        With `--hash', fail the test unless every\n" \
+"                         stream downloaded a file with the hex DIGEST\n" \
+"  --save=FILE            Write the file to FILE through large aligned\n" \
+"                         buffers and a writer thread, and show how fast\n"\
+"                         the disk was next to the network\n" \
 "  -?, -h, --help         Show this message and exit\n" \
 "  -v, --version          Show version information and exit\n" \
 "NOTES:\n" \
@@ -79,7 +236,11 @@
 "  - If neither options `--metric' nor `--binary' are given, `--metric' is\n" \
 "    implied.\n" \
 "  - If none of the options `--small', `--medium' nor `--large' are given,\n" \
-"    `--medium' is implied"
+"    `--medium' is implied\n" \
+"  - Unless `--keep' or `--save' is given, nothing is written to disk;\n" \
+"    the temporary file used by `--keep' is removed when the test is\n" \
+"    finished (with `--daemon' it is reused by every test and removed on\n" \
+"    exit)"
 
 #define DSP_VERSION_OUTPUT \
 DSP_DEFAULT_PROGRAM_NAME " " DSP_VERSION "\n" \
@@ -98,11 +259,25 @@ DSP_DEFAULT_PROGRAM_NAME " " DSP_VERSION "\n" \
  * The sizes of the files below are 12.87MB, 39.67MB and 82.14MB
  * for the small, medium and large respectively.
  */
-#define DSP_DEFAULT_URL_SMALL "http://ftp.gnu.org/gnu/gcc/gcc-2.95.1.tar.gz"
+#define DSP_GNU_URL "http://ftp.gnu.org/gnu/"
+#define DSP_DEFAULT_URL_SMALL DSP_GNU_URL "gcc/gcc-2.95.1.tar.gz"
 #define DSP_DEFAULT_URL_MEDIUM \
-    "http://ftp.gnu.org/gnu/gcc/gcc-4.7.0/gcc-4.6.3-4.7.0.diff.gz"
+    DSP_GNU_URL "gcc/gcc-4.7.0/gcc-4.6.3-4.7.0.diff.gz"
 #define DSP_DEFAULT_URL_LARGE \
-    "http://ftp.gnu.org/gnu/gcc/gcc-4.4.5/gcc-4.4.5.tar.gz"
+    DSP_GNU_URL "gcc/gcc-4.4.5/gcc-4.4.5.tar.gz"
+
+/*
+ * Mirrors of the above that --mirrors picks from unless given a list
+ * of its own. The path of the test file under `gnu/' is the same on
+ * all of them.
+ */
+#define DSP_DEFAULT_MIRRORS \
+    DSP_GNU_URL "," \
+    "http://mirrors.kernel.org/gnu/," \
+    "http://mirrors.ocf.berkeley.edu/gnu/," \
+    "http://mirror.csclub.uwaterloo.ca/gnu/," \
+    "http://ftp.halifax.rwth-aachen.de/gnu/," \
+    "http://ftp.jaist.ac.jp/pub/GNU/"
 
 /* tags for final output */
 #define DSP_TOTAL_DOWN_TIME_DISPLAY_TAG   "Total d/l time:   "
@@ -110,6 +285,52 @@ DSP_DEFAULT_PROGRAM_NAME " " DSP_VERSION "\n" \
 #define DSP_AVERAGE_DOWN_RATE_DISPLAY_TAG "Average d/l rate: "
 #define DSP_PEAK_DOWN_RATE_DISPLAY_TAG    "Peak d/l rate:    "
 #define DSP_LOWEST_DOWN_RATE_DISPLAY_TAG  "Lowest d/l rate:  "
+#define DSP_STREAM_DISPLAY_TAG            "Stream "
+#define DSP_MEAN_DOWN_RATE_DISPLAY_TAG    "Mean d/l rate:    "
+#define DSP_STDDEV_DISPLAY_TAG            "Std. deviation:   "
+#define DSP_VARIATION_DISPLAY_TAG         "Variation (CV):   "
+#define DSP_HISTOGRAM_DISPLAY_TAG         "Rate histogram:"
+#define DSP_STEADY_DOWN_RATE_DISPLAY_TAG  "Steady d/l rate:  "
+#define DSP_AUTO_SAVED_DISPLAY_TAG        "Saved by --auto:  "
+#define DSP_TESTS_RUN_DISPLAY_TAG         "Tests run:        "
+#define DSP_TESTS_FAILED_DISPLAY_TAG      "Tests failed:     "
+#define DSP_MEDIAN_DOWN_RATE_DISPLAY_TAG  "Median d/l rate:  "
+#define DSP_BODY_DOWN_RATE_DISPLAY_TAG    "Body d/l rate:    "
+#define DSP_NAMELOOKUP_DISPLAY_TAG        "DNS lookup:       "
+#define DSP_CONNECT_DISPLAY_TAG           "TCP connect:      "
+#define DSP_APPCONNECT_DISPLAY_TAG        "TLS handshake:    "
+#define DSP_PRETRANSFER_DISPLAY_TAG       "Request sent:     "
+#define DSP_STARTTRANSFER_DISPLAY_TAG     "First byte wait:  "
+#define DSP_BODY_TRANSFER_DISPLAY_TAG     "Body transfer:    "
+#define DSP_MIRROR_DISPLAY_TAG            "Mirror:           "
+#define DSP_CONNECTIONS_DISPLAY_TAG       "Connections:      "
+#define DSP_REQUESTS_DISPLAY_TAG          "Requests:         "
+#define DSP_TOTAL_SENT_DISPLAY_TAG        "Total sent:       "
+#define DSP_TOTAL_RECEIVED_DISPLAY_TAG    "Total received:   "
+#define DSP_DUPLEX_TIME_DISPLAY_TAG       "Duplex time:      "
+#define DSP_DUPLEX_DOWN_SIZE_DISPLAY_TAG  "Duplex d/l size:  "
+#define DSP_ALONE_DOWN_RATE_DISPLAY_TAG   "Alone d/l rate:   "
+#define DSP_DUPLEX_DOWN_RATE_DISPLAY_TAG  "Duplex d/l rate:  "
+#define DSP_LATENCY_DISPLAY_TAG           "Latency (RTT):"
+#define DSP_PROBES_DISPLAY_TAG            "Probes (failed):"
+#define DSP_ADDED_LATENCY_DISPLAY_TAG     "Added latency:    "
+#define DSP_BEST_RUN_DISPLAY_TAG          "Best run:         "
+#define DSP_TTFB_DISPLAY_TAG              "Time to 1st byte: "
+#define DSP_CRC32C_DISPLAY_TAG            "CRC-32C:          "
+#define DSP_SHA256_DISPLAY_TAG            "SHA-256:          "
+#define DSP_INTEGRITY_DISPLAY_TAG         "Integrity:        "
+#define DSP_SAVED_TO_DISPLAY_TAG          "Saved to:         "
+#define DSP_STORAGE_RATE_DISPLAY_TAG      "Storage rate:     "
+#define DSP_END_TO_END_RATE_DISPLAY_TAG   "End-to-end rate:  "
+#define DSP_DISK_WAIT_DISPLAY_TAG         "Waited for disk:  "
+#define DSP_BOTTLENECK_DISPLAY_TAG        "Bottleneck:       "
+
+/* percentiles of the sampled rates shown with the results */
+#define DSP_PERCENTILES {5, 25, 50, 75, 95, 99}
+#define DSP_N_PERCENTILES 6
+
+/* width of the longest bar in the --histogram output */
+#define DSP_HISTOGRAM_BAR_WIDTH 30
 
 /* show this if the result data was not set for some reason */
 #define DSP_UNKNOWN_DISPLAY_DATA "(unknown)"
@@ -150,15 +371,186 @@ DSP_DEFAULT_PROGRAM_NAME " " DSP_VERSION "\n" \
 #define DSP_SIZE_BUFFER_SIZE           32
 #define DSP_SPEED_BUFFER_SIZE          36
 #define DSP_TEMP_FILENAME_BUFFER_SIZE 256
+#define DSP_RANGE_BUFFER_SIZE          48
+#define DSP_DIGEST_BUFFER_SIZE        ((2 * DSP_MAX_DIGEST_SIZE) + 1)
+
+/* limits for the --streams=N option */
+#define DSP_MAX_STREAMS 64
+
+/* number of streams used by --segmented unless --streams=N is given */
+#define DSP_DEFAULT_SEGMENTED_STREAMS 4
+
+/* a stream that finished its range only takes over half of
+   another stream's remaining range if it is at least this big */
+#define DSP_MIN_SEGMENT_SPLIT_SIZE ((dsp_byte_t)524288LLU)
+
+/* default and limits for the --interval=MS option */
+#define DSP_DEFAULT_SAMPLE_INTERVAL_MS   100
+#define DSP_MAX_SAMPLE_INTERVAL_MS     60000
+
+/* number of samples a series has room for before it first grows */
+#define DSP_INITIAL_SERIES_CAPACITY 1024
+
+/*
+ * The steady state is found by comparing the rate over a window of
+ * samples with the rate over the window right after it. It starts
+ * once the later window is no more than DSP_STEADY_STATE_SLOPE
+ * (as a fraction) faster. A window is at least this long.
+ */
+#define DSP_STEADY_STATE_WINDOW_MS 500
+#define DSP_STEADY_STATE_SLOPE     0.1
+
+/*
+ * Default and limits for --auto[=PCT]. The estimate needs at least
+ * DSP_AUTO_MIN_SAMPLES interval rates before it can be trusted, and
+ * DSP_CONFIDENCE_Z is the z-score of a 95% confidence interval.
+ */
+#define DSP_DEFAULT_AUTO_PERCENT  2.0
+#define DSP_MIN_AUTO_PERCENT      0.01
+#define DSP_MAX_AUTO_PERCENT     50.0
+#define DSP_AUTO_MIN_SAMPLES     30
+#define DSP_CONFIDENCE_Z          1.96
+
+/*
+ * Limits for --repeat=N and --pause=SECONDS. The 95% confidence
+ * interval of the mean of the runs takes the critical values of
+ * Student's t from DSP_T_CRITICAL for up to DSP_T_CRITICAL_MAX_DF
+ * degrees of freedom and an approximation above that.
+ */
+#define DSP_MAX_REPEAT           1000
+#define DSP_MAX_PAUSE_SECONDS    3600.0
+#define DSP_T_CRITICAL_MAX_DF    30
+#define DSP_T_CRITICAL {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, \
+    2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, \
+    2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, \
+    2.048, 2.045, 2.042}
+
+/* limit for the --duration=SECONDS option */
+#define DSP_MAX_DURATION_SECONDS 604800.0
+
+/*
+ * Default and limits for --daemon[=SECONDS]. The start of each test
+ * is moved by a random amount of up to DSP_DAEMON_JITTER (as a
+ * fraction) of SECONDS either way, so that many copies started at the
+ * same time don't all hit the server together.
+ */
+#define DSP_DEFAULT_DAEMON_SECONDS 300.0
+#define DSP_MIN_DAEMON_SECONDS       1.0
+#define DSP_MAX_DAEMON_SECONDS  604800.0
+#define DSP_DAEMON_JITTER            0.1
+
+/* number of test results a --daemon keeps, the oldest ones are
+   overwritten so memory use stays the same however long it runs */
+#define DSP_HISTORY_SIZE 1024
+
+/*
+ * The --metrics listener binds to this address unless one is given.
+ * A request is read into a buffer of DSP_METRICS_REQUEST_SIZE bytes
+ * and a client gets DSP_METRICS_TIMEOUT_SEC seconds to send it and
+ * to take the response before it is dropped.
+ */
+#define DSP_DEFAULT_METRICS_ADDRESS "127.0.0.1"
+#define DSP_METRICS_BUFFER_SIZE     8192
+#define DSP_METRICS_REQUEST_SIZE    2048
+#define DSP_METRICS_TIMEOUT_SEC        2
+
+/*
+ * Default and limits for --latency[=MS]. Before the test the idle
+ * latency is measured with DSP_IDLE_PROBES probes that are
+ * DSP_IDLE_PROBE_SPACING_MS apart. A probe that hasn't connected
+ * after DSP_PROBE_TIMEOUT_MS counts as failed, and only the latest
+ * DSP_MAX_PROBES probes of a test are kept.
+ */
+#define DSP_DEFAULT_LATENCY_INTERVAL_MS   200
+#define DSP_MIN_LATENCY_INTERVAL_MS        10
+#define DSP_MAX_LATENCY_INTERVAL_MS     10000
+#define DSP_IDLE_PROBES                    10
+#define DSP_IDLE_PROBE_SPACING_MS          50
+#define DSP_PROBE_TIMEOUT_MS             2000L
+#define DSP_MAX_PROBES                   4096
+
+/* limit for the --warmup=SECONDS option */
+#define DSP_MAX_WARMUP_SECONDS 3600.0
+
+/* how many --mirrors are looked at, and how long each may take to
+   answer the HEAD request (the connect has DSP_PROBE_TIMEOUT_MS) */
+#define DSP_MAX_MIRRORS         32
+#define DSP_MIRROR_TIMEOUT_MS 5000L
+
+/*
+ * --serve: what a GET sends unless its path asks for a size, the most
+ * of a request's head (or a chunk size line) that is read, how much
+ * of a request is read at once, how many copies of the upload buffer
+ * go out in one writev(), how long a connection may stay idle, and
+ * how long --serve-delay may be.
+ */
+#define DSP_SERVE_HEAD_SIZE      8192
+#define DSP_SERVE_BUFFER_SIZE   65536
+#define DSP_SERVE_IOVECS           16
+#define DSP_SERVE_TIMEOUT_SEC      60
+#define DSP_MAX_SERVE_DELAY_MS  60000
+
+/* --serve-rate is kept in slices of 1/DSP_SERVE_PACE_DIVISOR seconds */
+#define DSP_SERVE_PACE_DIVISOR    100
+
+/*
+ * --buffer-size, --rcvbuf, --nodelay and --congestion take up to
+ * DSP_MAX_SWEEP_VALUES comma-separated values for a --sweep, and the
+ * sizes have limits (libcurl's for the buffer).
+ */
+#define DSP_MAX_SWEEP_VALUES      16
+#define DSP_MIN_BUFFER_SIZE       DSP_BINARY_KIBI
+#define DSP_MAX_BUFFER_SIZE       (10 * DSP_BINARY_MEBI)
+#define DSP_MAX_RCVBUF            DSP_BINARY_GIBI
+#define DSP_DEFAULT_BUFFER_SIZE   ((dsp_byte_t)CURL_MAX_WRITE_SIZE)
+#define DSP_MULTIPLEX_BUFFER_SIZE (512 * DSP_BINARY_KIBI)
+
+/* how many streams --compare-http puts on its one HTTP/2 connection
+   unless told otherwise */
+#define DSP_DEFAULT_COMPARE_STREAMS 4
+
+/* what --upload sends over each stream unless told otherwise, and the
+   buffer of generated data that every upload is made from */
+#define DSP_DEFAULT_UPLOAD_SIZE ((dsp_byte_t)41943040LLU)
+#define DSP_MAX_UPLOAD_SIZE     DSP_BINARY_TEBI
+#define DSP_UPLOAD_BUFFER_SIZE  65536
+#define DSP_DEFAULT_SERVE_SIZE  DSP_DEFAULT_UPLOAD_SIZE
+
+/* --save copies what the streams receive into buffers of
+   DSP_SAVE_BUFFER_SIZE bytes, aligned for O_DIRECT, that a thread
+   writes out: one for each stream to fill and a few being written */
+#define DSP_SAVE_BUFFER_SIZE   ((size_t)(4 * DSP_BINARY_MEBI))
+#define DSP_SAVE_ALIGNMENT     4096
+#define DSP_SAVE_SPARE_BUFFERS 4
+
+/* the disk held up the test if it waited this part of the time for a
+   buffer to be written */
+#define DSP_SAVE_STALL_LIMIT 0.01
+
+/* room for --live lines that couldn't be written yet, lines that
+   don't fit are dropped rather than holding up the test */
+#define DSP_LIVE_BUFFER_SIZE 65536
+#define DSP_LIVE_LINE_SIZE     256
+
+/* number of interval rates kept for the statistics, no matter
+   how long the test runs (must be an even number) */
+#define DSP_STATS_CAPACITY 4096
 
 /* use this if the width of the console can't be determined */
 #define DSP_FALLBACK_CONSOLE_WIDTH 40
 
+/* the progress display is drawn at most this many times a second, into
+   a line of at most DSP_PROGRESS_LINE_SIZE bytes */
+#define DSP_PROGRESS_FRAME_RATE  10
+#define DSP_PROGRESS_LINE_SIZE  512
+
 /* constants for dealing with time stuff */
 #define DSP_SECONDS_IN_DAY    86400
 #define DSP_SECONDS_IN_HOUR    3600
 #define DSP_SECONDS_IN_MINUTE    60
 
+#define DSP_HOURS_IN_DAY         24
+
 #define DSP_MOD_VALUE_FOR_SECONDS 60
 
 /* system specific utilities */
@@ -193,24 +585,64 @@ typedef unsigned char dsp_boolean_t;
 
 
 /* custom byte type for when dealing
-   specifically with values pertaining to bytes */
+   specifically with values pertaining to bytes, 64 bits wide
+   everywhere so that long tests don't wrap around on 32-bit systems */
 /* {{{ */
-typedef unsigned long dsp_byte_t;
+typedef unsigned long long dsp_byte_t;
 
 /* initialization value */
-#define DSP_ZERO_BYTES ((dsp_byte_t)0LU)
+#define DSP_ZERO_BYTES ((dsp_byte_t)0LLU)
 
 /* units defined by the International Electrotechnical Commission (IEC) */
-#define DSP_BINARY_KIBI ((dsp_byte_t)1024LU)
-#define DSP_BINARY_MEBI ((dsp_byte_t)1048576LU)
-#define DSP_BINARY_GIBI ((dsp_byte_t)1073741824LU)
-#define DSP_BINARY_TEBI ((dsp_byte_t)1099511627776LU)
+#define DSP_BINARY_KIBI ((dsp_byte_t)1024LLU)
+#define DSP_BINARY_MEBI ((dsp_byte_t)1048576LLU)
+#define DSP_BINARY_GIBI ((dsp_byte_t)1073741824LLU)
+#define DSP_BINARY_TEBI ((dsp_byte_t)1099511627776LLU)
 
 /* units defined by the International System of Units (SI) */
-#define DSP_METRIC_KILO ((dsp_byte_t)1000LU)
-#define DSP_METRIC_MEGA ((dsp_byte_t)1000000LU)
-#define DSP_METRIC_GIGA ((dsp_byte_t)1000000000LU)
-#define DSP_METRIC_TERA ((dsp_byte_t)1000000000000LU)
+#define DSP_METRIC_KILO ((dsp_byte_t)1000LLU)
+#define DSP_METRIC_MEGA ((dsp_byte_t)1000000LLU)
+#define DSP_METRIC_GIGA ((dsp_byte_t)1000000000LLU)
+#define DSP_METRIC_TERA ((dsp_byte_t)1000000000000LLU)
+/* }}} */
+
+/* custom type for points and spans of time from the monotonic clock */
+/* {{{ */
+typedef unsigned long long dsp_nsec_t;
+
+#define DSP_ZERO_NSEC   ((dsp_nsec_t)0LLU)
+#define DSP_NSEC_IN_MSEC ((dsp_nsec_t)1000000LLU)
+#define DSP_NSEC_IN_SEC ((dsp_nsec_t)1000000000LLU)
+/* }}} */
+
+/* values for the --format=FORMAT option */
+/* {{{ */
+typedef unsigned int dsp_format_t;
+
+#define DSP_FORMAT_TEXT 0
+#define DSP_FORMAT_JSON 1
+#define DSP_FORMAT_CSV  2
+/* }}} */
+
+/* values for the --hash=ALGORITHM option */
+/* {{{ */
+typedef unsigned int dsp_hash_t;
+
+#define DSP_HASH_NONE   0
+#define DSP_HASH_CRC32C 1
+#define DSP_HASH_SHA256 2
+
+#define DSP_MAX_DIGEST_SIZE 32
+/* }}} */
+
+/* values for the --http=VERSION option */
+/* {{{ */
+typedef unsigned int dsp_http_t;
+
+#define DSP_HTTP_DEFAULT 0
+#define DSP_HTTP_1_1     1
+#define DSP_HTTP_2       2
+#define DSP_HTTP_3       3
 /* }}} */
 
 /* custom type for the -n/--unit command */
@@ -228,9 +660,25 @@ typedef unsigned int dsp_unit_option_t;
 const char *program_name;
 
 char *            user_supplied_url   = NULL;
-char *            temp_file_path      = NULL;
-time_t            start_time          = -1;
-time_t            end_time            = -1;
+dsp_nsec_t        start_time          = DSP_ZERO_NSEC;
+dsp_nsec_t        end_time            = DSP_ZERO_NSEC;
+dsp_nsec_t        sample_interval     =
+    (DSP_DEFAULT_SAMPLE_INTERVAL_MS * DSP_NSEC_IN_MSEC);
+dsp_nsec_t        warmup_time         = DSP_ZERO_NSEC;
+dsp_boolean_t     warmup_given        = DSP_FALSE;
+dsp_nsec_t        test_duration       = DSP_ZERO_NSEC;
+dsp_nsec_t        stop_time           = DSP_ZERO_NSEC;
+dsp_nsec_t        daemon_interval     = DSP_ZERO_NSEC;
+dsp_nsec_t        latency_interval    = DSP_ZERO_NSEC;
+time_t            test_started        = 0;
+char *            metrics_address     = NULL;
+char *            duplex_url          = NULL;
+char *            mirror_list         = NULL;
+char *            serve_address       = NULL;
+char *            save_path           = NULL;
+dsp_byte_t        serve_rate          = DSP_ZERO_BYTES;
+dsp_nsec_t        serve_delay         = DSP_ZERO_NSEC;
+dsp_byte_t        upload_size         = DSP_ZERO_BYTES;
 dsp_boolean_t     use_bit             = DSP_FALSE;
 dsp_boolean_t     use_byte            = DSP_FALSE;
 dsp_boolean_t     use_metric          = DSP_FALSE;
@@ -238,23 +686,361 @@ dsp_boolean_t     use_binary          = DSP_FALSE;
 dsp_boolean_t     small_test          = DSP_FALSE;
 dsp_boolean_t     medium_test         = DSP_FALSE;
 dsp_boolean_t     large_test          = DSP_FALSE;
+dsp_boolean_t     keep_payload        = DSP_FALSE;
+dsp_boolean_t     segmented           = DSP_FALSE;
+dsp_boolean_t     show_histogram      = DSP_FALSE;
+dsp_boolean_t     upload              = DSP_FALSE;
+dsp_boolean_t     use_post            = DSP_FALSE;
+dsp_boolean_t     duplex              = DSP_FALSE;
+dsp_boolean_t     sweep               = DSP_FALSE;
+dsp_http_t        http_version        = DSP_HTTP_DEFAULT;
+dsp_boolean_t     multiplex           = DSP_FALSE;
+unsigned int      compare_streams     = 0;
+unsigned int      repeat_count        = 0;
+dsp_nsec_t        repeat_pause        = DSP_ZERO_NSEC;
+dsp_boolean_t     fresh_connections   = DSP_FALSE;
+dsp_hash_t        hash_algorithm      = DSP_HASH_NONE;
+unsigned char     expected_digest[DSP_MAX_DIGEST_SIZE];
+size_t            expected_digest_size = 0;
+double            auto_percent        = 0.0;
+dsp_format_t      output_format       = DSP_FORMAT_TEXT;
+dsp_boolean_t     live_output         = DSP_FALSE;
 dsp_byte_t        total_bytes         = DSP_ZERO_BYTES;
 dsp_byte_t        most_bytes_per_sec  = DSP_ZERO_BYTES;
 dsp_byte_t        least_bytes_per_sec = DSP_ZERO_BYTES;
 dsp_unit_option_t unit_option         = DSP_UNIT_OPTION_0;
-
-struct {
+unsigned int      stream_count        = 0;
+unsigned int      allocated_streams   = 0;
+unsigned int      test_streams        = 0;
+unsigned int      mirror_sources      = 0;
+CURLM *           multi_handle        = NULL;
+CURL *            probe_handle        = NULL;
+struct curl_slist *upload_headers     = NULL;
+char *            object_url          = NULL;
+dsp_byte_t        object_size         = DSP_ZERO_BYTES;
+dsp_boolean_t     test_ran            = DSP_FALSE;
+int               range_file_fd       = -1;
+
+/* filled once by dsp_fill_upload_buffer() and sent over and over */
+unsigned char upload_buffer[DSP_UPLOAD_BUFFER_SIZE];
+
+struct dsp_display_data {
     char total_down_time[DSP_TIME_BUFFER_SIZE];
     char total_down_size[DSP_SIZE_BUFFER_SIZE];
     char average_down_rate[DSP_SPEED_BUFFER_SIZE];
+    char body_down_rate[DSP_SPEED_BUFFER_SIZE];
     char peak_down_rate[DSP_SPEED_BUFFER_SIZE];
     char lowest_down_rate[DSP_SPEED_BUFFER_SIZE];
 } display_data;
 
+/* how much had been received at a point in time during the test */
+struct dsp_sample {
+    dsp_nsec_t t; /* since start_time */
+    dsp_byte_t bytes;
+};
+
+/* samples taken every --interval=MS from the start of the test */
+struct dsp_series {
+    struct dsp_sample *samples;
+    size_t             count;
+    size_t             capacity;
+} download_series;
+
+/* a --mirrors candidate and how it answered */
+struct dsp_mirror {
+    char *        url;
+    CURL *        cp;
+    double        rtt;
+    dsp_boolean_t responsive;
+    dsp_boolean_t used;
+} mirrors[DSP_MAX_MIRRORS];
+
+size_t mirror_count = 0;
+
+/* with --duplex, the bytes of each direction (download first) */
+struct dsp_series duplex_series[2];
+
+/* how the connections of a test are set up, see dsp_sockopt_callback() */
+struct dsp_tuning {
+    dsp_byte_t  buffer_size; /* 0 leaves libcurl's */
+    dsp_byte_t  rcvbuf;      /* 0 leaves the system's */
+    int         nodelay;     /* -1 leaves libcurl's */
+    const char *congestion;  /* NULL leaves the system's */
+} tuning = {DSP_ZERO_BYTES, DSP_ZERO_BYTES, -1, NULL};
+
+/* what the system made of --rcvbuf on the latest connection */
+dsp_byte_t effective_rcvbuf = DSP_ZERO_BYTES;
+
+/* the values given to --buffer-size, --rcvbuf, --nodelay and
+   --congestion, every combination of which is tried by a --sweep */
+struct {
+    dsp_byte_t  buffer_sizes[DSP_MAX_SWEEP_VALUES];
+    size_t      n_buffer_sizes;
+    dsp_byte_t  rcvbufs[DSP_MAX_SWEEP_VALUES];
+    size_t      n_rcvbufs;
+    int         nodelays[DSP_MAX_SWEEP_VALUES];
+    size_t      n_nodelays;
+    char *      congestions[DSP_MAX_SWEEP_VALUES];
+    size_t      n_congestions;
+} sweep_values;
+
+/* the outcome of one run of a --sweep */
+struct dsp_sweep_result {
+    struct dsp_tuning tuning;
+    dsp_byte_t        effective_rcvbuf;
+    dsp_boolean_t     succeeded;
+    dsp_byte_t        bytes;
+    dsp_nsec_t        elapsed;
+    double            average_bytes_per_sec;
+    double            steady_bytes_per_sec; /* -1 if there is none */
+};
+
+/* the outcome of one run of a --compare-http */
+struct dsp_compare_result {
+    char          label[16];   /* `HTTP/2 x4' */
+    dsp_http_t    version;
+    dsp_boolean_t multiplexed;
+    unsigned int  streams;
+    const char *  skipped;     /* why it wasn't run, NULL if it was */
+    dsp_boolean_t succeeded;
+    long          negotiated;  /* CURL_HTTP_VERSION_*, 0 if unknown */
+    unsigned long connections;
+    dsp_byte_t    bytes;
+    dsp_nsec_t    elapsed;
+    dsp_nsec_t    first_byte;  /* 0 if unknown */
+    double        average_bytes_per_sec;
+    double        body_bytes_per_sec; /* -1 if unknown */
+};
+
+/* the outcome of one run of a --repeat */
+struct dsp_repeat_run {
+    dsp_boolean_t succeeded;
+    unsigned long connections; /* made for this run, 0 if all reused */
+    dsp_byte_t    bytes;
+    dsp_nsec_t    elapsed;
+    dsp_nsec_t    first_byte;  /* 0 if unknown */
+    double        average_bytes_per_sec;
+    double        body_bytes_per_sec; /* -1 if unknown */
+};
+
+/* a quantity over the successful runs of a --repeat */
+struct dsp_summary {
+    size_t n;
+    double mean;
+    double median;
+    double half_width; /* of the 95% confidence interval, -1 if n < 2 */
+};
+
+/*
+ * Interval rates for the statistics. When the buffer is full every
+ * two neighbouring intervals are merged into one, and from then on
+ * each slot holds twice as many of the sampled intervals (`stride').
+ */
+struct dsp_stats {
+    struct {
+        float bytes;
+        float secs;
+    }      intervals[DSP_STATS_CAPACITY];
+    size_t count;
+    size_t stride;
+    size_t pending;
+} download_stats = {{{0.0f, 0.0f}}, 0, 1, 0};
+
+/* running mean and variance of the interval rates (Welford's method)
+   for deciding when --auto can stop the test */
+struct dsp_estimate {
+    size_t n;
+    double mean;
+    double m2;
+} download_estimate;
+
+/* --live lines waiting to be written to stdout */
+struct {
+    char          data[DSP_LIVE_BUFFER_SIZE];
+    size_t        length;
+    unsigned long dropped;
+    dsp_nsec_t    last_t;
+    dsp_byte_t    last_bytes;
+} live_buffer;
+
+/* what a test cost dsp itself, so that a client too slow for the
+   connection shows up (see `make bench') */
+struct {
+    dsp_nsec_t    cpu_time;
+    unsigned long data_callbacks;
+    unsigned long progress_callbacks;
+    unsigned long iterations;
+    dsp_nsec_t    housekeeping_time;
+} client_cost;
+
+/* the outcome of one test of a --daemon */
+struct dsp_result {
+    time_t        started;
+    dsp_boolean_t succeeded;
+    dsp_nsec_t    elapsed;
+    dsp_byte_t    bytes;
+    double        average_bytes_per_sec;
+    dsp_byte_t    most_bytes_per_sec;
+    dsp_byte_t    least_bytes_per_sec;
+};
+
+/* the latest DSP_HISTORY_SIZE results, `next' is the oldest
+   one once the buffer has filled up */
+struct {
+    struct dsp_result results[DSP_HISTORY_SIZE];
+    size_t            next;
+    size_t            count;
+    unsigned long     runs;
+    unsigned long     failures;
+    dsp_byte_t        bytes;
+} history;
+
+/* round-trip times of the --latency probes of a test */
+struct dsp_probes {
+    dsp_nsec_t    rtts[DSP_MAX_PROBES];
+    size_t        count;
+    size_t        next;
+    unsigned long sent;
+    unsigned long failed;
+} idle_probes, loaded_probes;
+
+/* the loaded probes are made by a thread of their own so they never
+   wait for (or hold up) the transfers in dsp_run_streams() */
+#ifdef DSP_HAVE_THREADS
+pthread_t       probe_thread;
+pthread_mutex_t probe_lock     = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  probe_wake     = PTHREAD_COND_INITIALIZER;
+dsp_boolean_t   probe_stopping = DSP_FALSE;
+#endif
+
+/* set by SIGINT and SIGTERM to make a --daemon finish */
+volatile sig_atomic_t daemon_stopping = 0;
+
+/* set by SIGWINCH, the progress display then asks for the width again */
+volatile sig_atomic_t console_resized = 0;
+
+/* the progress display, which is only drawn when stdout is a terminal */
+struct {
+    dsp_boolean_t enabled;
+    int           width;
+    dsp_nsec_t    drawn;
+    char          line[DSP_PROGRESS_LINE_SIZE];
+} progress;
+
+/* what libcurl measured of a stream's first transfer, in seconds
+   from the start of that transfer */
+struct dsp_timings {
+    double namelookup;
+    double connect;
+    double appconnect;
+    double pretransfer;
+    double starttransfer;
+    double total;
+};
+
+/* the state of a --hash of one stream, see dsp_hash_update() */
+struct dsp_hash {
+    uint32_t      crc;
+    uint32_t      state[8];
+    unsigned char block[64];
+    size_t        used;
+    dsp_byte_t    length;
+};
+
+/* part of the --save file, `length' bytes of it from `offset' on */
+struct dsp_save_buffer {
+    unsigned char *         data;
+    size_t                  length;
+    dsp_byte_t              offset;
+    struct dsp_save_buffer *next;
+};
+
+/*
+ * The --save file and how writing it went. The write callback fills
+ * buffers taken from `spare' and puts them on `queue', from which the
+ * writer thread takes them and puts them back on `spare' once they are
+ * written. `fd' was opened with O_DIRECT if `direct', `tail_fd' writes
+ * what isn't aligned through the page cache.
+ */
+struct {
+    int                     fd;
+    int                     tail_fd;
+    dsp_boolean_t           direct;
+    dsp_boolean_t           preallocated;
+    dsp_boolean_t           writing;
+    dsp_boolean_t           stopping;
+    int                     error;
+    dsp_byte_t              size_hint;
+    dsp_byte_t              end;
+    dsp_byte_t              bytes;
+    dsp_nsec_t              write_time;
+    dsp_nsec_t              stall_time;
+    dsp_nsec_t              drain_time;
+    struct dsp_save_buffer *pool;
+    size_t                  pool_size;
+    struct dsp_save_buffer *spare;
+    struct dsp_save_buffer *queue;
+    struct dsp_save_buffer *queue_tail;
+} save_file;
+
+#ifdef DSP_HAVE_SAVE
+pthread_t       save_thread;
+pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  save_wake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t  save_done = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* one connection of the test, see --streams=N. A --daemon keeps
+   them (and the connections of their handles) between tests */
+struct dsp_stream {
+    unsigned int id;
+    CURL *       cp;
+    FILE *       fp;
+    char *       temp_file_path;
+    dsp_nsec_t   end_time;
+    CURLcode     status;
+    dsp_byte_t   d_total;
+    dsp_byte_t   d_current;
+    dsp_byte_t   total_bytes;
+    dsp_byte_t   most_bytes_per_sec;
+    dsp_byte_t   least_bytes_per_sec;
+    struct dsp_series  series;
+    struct dsp_timings timings;
+    /* sends an --upload (or the upload half of a --duplex) */
+    dsp_boolean_t sending;
+    /* with --sources, the mirror the stream downloads from */
+    const char *  url;
+    /* the byte range this stream is working on, only with --segmented */
+    dsp_byte_t    range_pos;
+    dsp_byte_t    range_end;
+    dsp_boolean_t range_checked;
+    dsp_boolean_t range_done;
+    /* with --hash, and its digest once all of the file came in */
+    struct dsp_hash hash;
+    dsp_boolean_t   hashed;
+    unsigned char   digest[DSP_MAX_DIGEST_SIZE];
+    /* with --save, the buffer it is filling */
+    struct dsp_save_buffer *save_buffer;
+} *streams = NULL;
+
+/* all of the streams, of which a test runs the `test_streams' from
+   `streams' on: --duplex runs each half on its own and then all */
+struct dsp_stream *stream_pool = NULL;
+
+/* what --duplex found out about one direction */
+struct dsp_direction {
+    dsp_byte_t bytes;
+    dsp_nsec_t elapsed;
+    double     alone_rate;
+    double     rate;
+    dsp_byte_t most_bytes_per_sec;
+    dsp_byte_t least_bytes_per_sec;
+} directions[2];
+
 static void dsp_show_usage(dsp_boolean_t error)
 {
     fprintf((!error) ? stdout : stderr,
-            "Usage: %s -[bBiLmMS] [--unit=UNIT] [--url=URL]\n",
+            "Usage: %s -[bBikLmMS] [--unit=UNIT] [--url=URL]\n",
             program_name);
 }
 
@@ -328,6 +1114,17 @@ static dsp_boolean_t dsp_does_string_start_with(const char *string,
     return DSP_FALSE;
 }
 
+static dsp_boolean_t dsp_does_string_start_with_nocase(const char *string,
+                                                       const char *prefix)
+{
+    for (; *prefix; ++string, ++prefix) {
+        if (!*string || (tolower((unsigned char)*string) !=
+                    tolower((unsigned char)*prefix)))
+            return DSP_FALSE;
+    }
+    return DSP_TRUE;
+}
+
 static void dsp_set_proper_program_name(char *argv0)
 {
     char *x;
@@ -382,18 +1179,328 @@ static dsp_boolean_t dsp_set_unit_option(char c)
   return DSP_TRUE;
 }
 
+/* matches both `--name' and `--name=VALUE' */
+static dsp_boolean_t dsp_is_long_option(const char *arg, const char *name)
+{
+    size_t n;
+
+    n = strlen(name);
+    if ((memcmp(arg, name, n) == 0) && ((arg[n] == '\0') || (arg[n] == '=')))
+        return DSP_TRUE;
+    return DSP_FALSE;
+}
+
+/*
+ * Return the argument of the long option at v[*x], given either
+ * as `--name=VALUE' or as `--name VALUE' (in which case *x is
+ * advanced past VALUE). Exits if there is no argument.
+ */
+static char *dsp_get_long_option_argument(char **v, size_t *x)
+{
+    char *s;
+
+    s = strchr(v[*x], '=');
+    if (s) {
+        if (*++s)
+            return s;
+    } else if (v[*x + 1] && (v[*x + 1][0] != '-'))
+        return v[++*x];
+
+    s = strchr(v[*x], '=');
+    if (s)
+        *s = '\0';
+    dsp_print_error("`%s' requires an argument", v[*x]);
+    dsp_show_usage(DSP_TRUE);
+    exit(EXIT_FAILURE);
+    return NULL; /* for compilers */
+}
+
+static unsigned long dsp_parse_uint_argument(const char *arg,
+                                             const char *option,
+                                             unsigned long min,
+                                             unsigned long max)
+{
+    char *end;
+    unsigned long n;
+
+    errno = 0;
+    n = strtoul(arg, &end, 10);
+    if ((errno != 0) || (end == arg) || *end || (*arg == '-') ||
+            (n < min) || (n > max)) {
+        dsp_print_error("`%s' is not a valid argument for `%s' "
+                "(expected a number from %lu to %lu)", arg, option, min, max);
+        dsp_show_usage(DSP_TRUE);
+        exit(EXIT_FAILURE);
+    }
+    return n;
+}
+
+static double dsp_parse_double_argument(const char *arg,
+                                        const char *option,
+                                        double min,
+                                        double max)
+{
+    char *end;
+    double n;
+
+    errno = 0;
+    n = strtod(arg, &end);
+    if ((errno != 0) || (end == arg) || *end || !(n >= min) || (n > max)) {
+        dsp_print_error("`%s' is not a valid argument for `%s' "
+                "(expected a number from %g to %g)", arg, option, min, max);
+        dsp_show_usage(DSP_TRUE);
+        exit(EXIT_FAILURE);
+    }
+    return n;
+}
+
+/* a number of bytes, optionally followed by K, M or G (binary), in
+   `bytes'. Returns DSP_FALSE if `arg' isn't one from `min' to `max' */
+static dsp_boolean_t dsp_get_size(const char *arg,
+                                  dsp_byte_t min,
+                                  dsp_byte_t max,
+                                  dsp_byte_t *bytes)
+{
+    char *end;
+    dsp_byte_t n;
+    dsp_byte_t unit;
+
+    errno = 0;
+    n = strtoull(arg, &end, 10);
+    switch (*end) {
+    case 'k':
+    case 'K':
+        unit = DSP_BINARY_KIBI;
+        break;
+    case 'm':
+    case 'M':
+        unit = DSP_BINARY_MEBI;
+        break;
+    case 'g':
+    case 'G':
+        unit = DSP_BINARY_GIBI;
+        break;
+    default:
+        unit = 1;
+        break;
+    }
+    if (unit > 1)
+        ++end;
+    if ((errno != 0) || (end == arg) || *end || (*arg == '-') ||
+            (n > (max / unit)) || ((n * unit) < min))
+        return DSP_FALSE;
+    *bytes = (n * unit);
+    return DSP_TRUE;
+}
+
+static dsp_byte_t dsp_parse_size_argument(const char *arg,
+                                          const char *option,
+                                          dsp_byte_t min,
+                                          dsp_byte_t max)
+{
+    dsp_byte_t bytes;
+
+    if (!dsp_get_size(arg, min, max, &bytes)) {
+        dsp_print_error("`%s' is not a valid argument for `%s' "
+                "(expected a size from %llu to %llu bytes)", arg, option, min,
+                max);
+        dsp_show_usage(DSP_TRUE);
+        exit(EXIT_FAILURE);
+    }
+    return bytes;
+}
+
+/* split the comma-separated `arg' of `option' (in place) into
+   `values', returns how many there are */
+static size_t dsp_split_list(char *arg, const char *option, char **values)
+{
+    size_t n;
+    char *s;
+
+    n = 0;
+    for (s = strtok(arg, ","); s; s = strtok(NULL, ",")) {
+        if (n == DSP_MAX_SWEEP_VALUES) {
+            dsp_print_error("`%s' takes at most %d values", option,
+                    DSP_MAX_SWEEP_VALUES);
+            exit(EXIT_FAILURE);
+        }
+        values[n++] = s;
+    }
+    if (!n) {
+        dsp_print_error("`%s' requires an argument", option);
+        dsp_show_usage(DSP_TRUE);
+        exit(EXIT_FAILURE);
+    }
+    return n;
+}
+
+static size_t dsp_parse_size_list(char *arg,
+                                  const char *option,
+                                  dsp_byte_t min,
+                                  dsp_byte_t max,
+                                  dsp_byte_t *sizes)
+{
+    size_t x;
+    size_t n;
+    char *values[DSP_MAX_SWEEP_VALUES];
+
+    n = dsp_split_list(arg, option, values);
+    for (x = 0; x < n; ++x)
+        sizes[x] = dsp_parse_size_argument(values[x], option, min, max);
+    return n;
+}
+
+/* how many runs a --sweep makes, one for every combination */
+static size_t dsp_get_sweep_runs(void)
+{
+    size_t n;
+
+    n = 1;
+    if (sweep_values.n_buffer_sizes)
+        n *= sweep_values.n_buffer_sizes;
+    if (sweep_values.n_rcvbufs)
+        n *= sweep_values.n_rcvbufs;
+    if (sweep_values.n_nodelays)
+        n *= sweep_values.n_nodelays;
+    if (sweep_values.n_congestions)
+        n *= sweep_values.n_congestions;
+    return n;
+}
+
+/* the combination of settings of `run' of a --sweep (the buffer size
+   changes with every run, the congestion control the least often) */
+static void dsp_get_tuning(size_t run, struct dsp_tuning *t)
+{
+    t->buffer_size = DSP_ZERO_BYTES;
+    t->rcvbuf = DSP_ZERO_BYTES;
+    t->nodelay = -1;
+    t->congestion = NULL;
+    if (sweep_values.n_buffer_sizes) {
+        t->buffer_size =
+            sweep_values.buffer_sizes[run % sweep_values.n_buffer_sizes];
+        run /= sweep_values.n_buffer_sizes;
+    }
+    if (sweep_values.n_rcvbufs) {
+        t->rcvbuf = sweep_values.rcvbufs[run % sweep_values.n_rcvbufs];
+        run /= sweep_values.n_rcvbufs;
+    }
+    if (sweep_values.n_nodelays) {
+        t->nodelay = sweep_values.nodelays[run % sweep_values.n_nodelays];
+        run /= sweep_values.n_nodelays;
+    }
+    if (sweep_values.n_congestions)
+        t->congestion =
+            sweep_values.congestions[run % sweep_values.n_congestions];
+}
+
+/* exit unless the system has the congestion control algorithm `name' */
+static void dsp_check_congestion(const char *name)
+{
+#if defined(DSP_HAVE_SOCKET_OPTIONS) && defined(TCP_CONGESTION)
+    int fd;
+    int s_errno;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name,
+                (socklen_t)strlen(name)) == 0) {
+        close(fd);
+        return;
+    }
+    s_errno = errno;
+    close(fd);
+    dsp_print_error("congestion control `%s' is not available (%s)", name,
+            strerror(s_errno));
+#else
+    dsp_print_error("`--congestion' is not supported on this system");
+#endif
+    exit(EXIT_FAILURE);
+}
+
+/* a list of `on' and `off' as ones and zeros */
+static size_t dsp_parse_switch_list(char *arg,
+                                    const char *option,
+                                    int *switches)
+{
+    size_t x;
+    size_t n;
+    char *values[DSP_MAX_SWEEP_VALUES];
+
+    n = dsp_split_list(arg, option, values);
+    for (x = 0; x < n; ++x) {
+        if (dsp_are_strings_equal(values[x], "on"))
+            switches[x] = 1;
+        else if (dsp_are_strings_equal(values[x], "off"))
+            switches[x] = 0;
+        else {
+            dsp_print_error("`%s' is not a valid argument for `%s'",
+                    values[x], option);
+            dsp_show_usage(DSP_TRUE);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return n;
+}
+
+/* the name of `hash_algorithm' as --hash takes it */
+static const char *dsp_get_hash_name(void)
+{
+    return (hash_algorithm == DSP_HASH_SHA256) ? "sha256" : "crc32c";
+}
+
+/* the size in bytes of a digest of `hash_algorithm' */
+static size_t dsp_get_digest_size(void)
+{
+    return (hash_algorithm == DSP_HASH_SHA256) ? 32 : 4;
+}
+
+/* the hex digest of --expect, in either case, into `digest'. Returns
+   its size in bytes */
+static size_t dsp_parse_digest_argument(const char *arg,
+                                        unsigned char *digest)
+{
+    size_t x;
+    size_t n;
+    int c;
+    int v;
+
+    n = strlen(arg);
+    if (((n != 8) && (n != 64)) || (strspn(arg, "0123456789abcdefABCDEF")
+                != n)) {
+        dsp_print_error("`%s' is not a valid argument for `--expect' "
+                "(expected 8 or 64 hex digits)", arg);
+        dsp_show_usage(DSP_TRUE);
+        exit(EXIT_FAILURE);
+    }
+    for (x = 0; x < n; ++x) {
+        c = tolower((unsigned char)arg[x]);
+        v = (isdigit(c)) ? (c - '0') : (c - 'a' + 10);
+        if (x % 2)
+            digest[x / 2] |= (unsigned char)v;
+        else
+            digest[x / 2] = (unsigned char)(v << 4);
+    }
+    return (n / 2);
+}
+
 static void dsp_parse_options(char **v)
 {
     size_t x;
     size_t y;
     char *s;
+    dsp_boolean_t format_given;
 
     dsp_set_proper_program_name(v[0]);
+    format_given = DSP_FALSE;
 
     if (!v[1]) {
         use_byte = DSP_TRUE;
         use_metric = DSP_TRUE;
         medium_test = DSP_TRUE;
+        stream_count = 1;
         return;
     }
 
@@ -426,6 +1533,9 @@ static void dsp_parse_options(char **v)
         else if (dsp_are_strings_equal(v[x], "-L") ||
                 dsp_are_strings_equal(v[x], "--large"))
             large_test = DSP_TRUE;
+        else if (dsp_are_strings_equal(v[x], "-k") ||
+                dsp_are_strings_equal(v[x], "--keep"))
+            keep_payload = DSP_TRUE;
         else if (dsp_are_strings_equal(v[x], "-u") ||
                 dsp_are_strings_equal(v[x], "--url")) {
             if (!v[x + 1] || v[x + 1][0] == '-') {
@@ -445,6 +1555,168 @@ static void dsp_parse_options(char **v)
                 dsp_show_usage(DSP_TRUE);
                 exit(EXIT_FAILURE);
             }
+        } else if (dsp_is_long_option(v[x], "--format")) {
+            s = dsp_get_long_option_argument(v, &x);
+            format_given = DSP_TRUE;
+            if (dsp_are_strings_equal(s, "text"))
+                output_format = DSP_FORMAT_TEXT;
+            else if (dsp_are_strings_equal(s, "json"))
+                output_format = DSP_FORMAT_JSON;
+            else if (dsp_are_strings_equal(s, "csv"))
+                output_format = DSP_FORMAT_CSV;
+            else {
+                dsp_print_error("`%s' is not a valid argument for `--format'",
+                        s);
+                dsp_show_usage(DSP_TRUE);
+                exit(EXIT_FAILURE);
+            }
+        } else if (dsp_are_strings_equal(v[x], "--live")) {
+            live_output = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--latency")) {
+            s = strchr(v[x], '=');
+            latency_interval = (DSP_NSEC_IN_MSEC * ((s) ?
+                    dsp_parse_uint_argument(s + 1, "--latency",
+                        DSP_MIN_LATENCY_INTERVAL_MS,
+                        DSP_MAX_LATENCY_INTERVAL_MS) :
+                    DSP_DEFAULT_LATENCY_INTERVAL_MS));
+        } else if (dsp_are_strings_equal(v[x], "--histogram")) {
+            show_histogram = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--warmup")) {
+            warmup_time = (dsp_nsec_t)(DSP_NSEC_IN_SEC *
+                dsp_parse_double_argument(dsp_get_long_option_argument(v, &x),
+                    "--warmup", 0.0, DSP_MAX_WARMUP_SECONDS));
+            warmup_given = DSP_TRUE;
+        } else if (dsp_are_strings_equal(v[x], "--segmented")) {
+            segmented = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--daemon")) {
+            s = strchr(v[x], '=');
+            daemon_interval = (dsp_nsec_t)(DSP_NSEC_IN_SEC * ((s) ?
+                    dsp_parse_double_argument(s + 1, "--daemon",
+                        DSP_MIN_DAEMON_SECONDS, DSP_MAX_DAEMON_SECONDS) :
+                    DSP_DEFAULT_DAEMON_SECONDS));
+        } else if (dsp_is_long_option(v[x], "--metrics")) {
+            metrics_address = dsp_get_long_option_argument(v, &x);
+        } else if (dsp_is_long_option(v[x], "--upload")) {
+            s = strchr(v[x], '=');
+            upload = DSP_TRUE;
+            if (s)
+                upload_size = dsp_parse_size_argument(s + 1, "--upload", 1,
+                        DSP_MAX_UPLOAD_SIZE);
+        } else if (dsp_are_strings_equal(v[x], "--post")) {
+            use_post = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--serve")) {
+            serve_address = dsp_get_long_option_argument(v, &x);
+        } else if (dsp_is_long_option(v[x], "--serve-rate")) {
+            serve_rate = dsp_parse_size_argument(
+                    dsp_get_long_option_argument(v, &x), "--serve-rate", 1,
+                    DSP_MAX_UPLOAD_SIZE);
+        } else if (dsp_is_long_option(v[x], "--serve-delay")) {
+            serve_delay = (DSP_NSEC_IN_MSEC *
+                dsp_parse_uint_argument(dsp_get_long_option_argument(v, &x),
+                        "--serve-delay", 0, DSP_MAX_SERVE_DELAY_MS));
+        } else if (dsp_is_long_option(v[x], "--mirrors")) {
+            s = strchr(v[x], '=');
+            mirror_list = (s) ? (s + 1) : DSP_DEFAULT_MIRRORS;
+        } else if (dsp_is_long_option(v[x], "--sources")) {
+            mirror_sources = (unsigned int)
+                dsp_parse_uint_argument(dsp_get_long_option_argument(v, &x),
+                        "--sources", 1, DSP_MAX_MIRRORS);
+        } else if (dsp_is_long_option(v[x], "--buffer-size")) {
+            sweep_values.n_buffer_sizes = dsp_parse_size_list(
+                    dsp_get_long_option_argument(v, &x), "--buffer-size",
+                    DSP_MIN_BUFFER_SIZE, DSP_MAX_BUFFER_SIZE,
+                    sweep_values.buffer_sizes);
+        } else if (dsp_is_long_option(v[x], "--rcvbuf")) {
+            sweep_values.n_rcvbufs = dsp_parse_size_list(
+                    dsp_get_long_option_argument(v, &x), "--rcvbuf", 0,
+                    DSP_MAX_RCVBUF, sweep_values.rcvbufs);
+        } else if (dsp_is_long_option(v[x], "--nodelay")) {
+            s = strchr(v[x], '=');
+            if (!s) {
+                sweep_values.nodelays[0] = 1;
+                sweep_values.n_nodelays = 1;
+                continue;
+            }
+            sweep_values.n_nodelays = dsp_parse_switch_list(s + 1,
+                    "--nodelay", sweep_values.nodelays);
+        } else if (dsp_is_long_option(v[x], "--congestion")) {
+            sweep_values.n_congestions = dsp_split_list(
+                    dsp_get_long_option_argument(v, &x), "--congestion",
+                    sweep_values.congestions);
+        } else if (dsp_are_strings_equal(v[x], "--sweep")) {
+            sweep = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--http")) {
+            s = dsp_get_long_option_argument(v, &x);
+            if (dsp_are_strings_equal(s, "1.1"))
+                http_version = DSP_HTTP_1_1;
+            else if (dsp_are_strings_equal(s, "2"))
+                http_version = DSP_HTTP_2;
+            else if (dsp_are_strings_equal(s, "3"))
+                http_version = DSP_HTTP_3;
+            else {
+                dsp_print_error("`%s' is not a valid argument for `--http'",
+                        s);
+                dsp_show_usage(DSP_TRUE);
+                exit(EXIT_FAILURE);
+            }
+        } else if (dsp_are_strings_equal(v[x], "--multiplex")) {
+            multiplex = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--repeat")) {
+            repeat_count = (unsigned int)
+                dsp_parse_uint_argument(dsp_get_long_option_argument(v, &x),
+                        "--repeat", 2, DSP_MAX_REPEAT);
+        } else if (dsp_is_long_option(v[x], "--pause")) {
+            repeat_pause = (dsp_nsec_t)(DSP_NSEC_IN_SEC *
+                dsp_parse_double_argument(dsp_get_long_option_argument(v, &x),
+                    "--pause", 0.0, DSP_MAX_PAUSE_SECONDS));
+        } else if (dsp_are_strings_equal(v[x], "--fresh")) {
+            fresh_connections = DSP_TRUE;
+        } else if (dsp_is_long_option(v[x], "--hash")) {
+            s = dsp_get_long_option_argument(v, &x);
+            if (dsp_are_strings_equal(s, "crc32c"))
+                hash_algorithm = DSP_HASH_CRC32C;
+            else if (dsp_are_strings_equal(s, "sha256"))
+                hash_algorithm = DSP_HASH_SHA256;
+            else {
+                dsp_print_error("`%s' is not a valid argument for `--hash'",
+                        s);
+                dsp_show_usage(DSP_TRUE);
+                exit(EXIT_FAILURE);
+            }
+        } else if (dsp_is_long_option(v[x], "--save")) {
+            save_path = dsp_get_long_option_argument(v, &x);
+        } else if (dsp_is_long_option(v[x], "--expect")) {
+            expected_digest_size = dsp_parse_digest_argument(
+                    dsp_get_long_option_argument(v, &x), expected_digest);
+        } else if (dsp_is_long_option(v[x], "--compare-http")) {
+            s = strchr(v[x], '=');
+            compare_streams = (unsigned int)((s) ?
+                    dsp_parse_uint_argument(s + 1, "--compare-http", 1,
+                        DSP_MAX_STREAMS) : DSP_DEFAULT_COMPARE_STREAMS);
+        } else if (dsp_is_long_option(v[x], "--duplex")) {
+            s = strchr(v[x], '=');
+            duplex = DSP_TRUE;
+            if (s && *++s)
+                duplex_url = s;
+        } else if (dsp_is_long_option(v[x], "--auto")) {
+            s = strchr(v[x], '=');
+            if (s)
+                auto_percent = dsp_parse_double_argument(s + 1, "--auto",
+                        DSP_MIN_AUTO_PERCENT, DSP_MAX_AUTO_PERCENT);
+            else
+                auto_percent = DSP_DEFAULT_AUTO_PERCENT;
+        } else if (dsp_is_long_option(v[x], "--duration")) {
+            test_duration = (dsp_nsec_t)(DSP_NSEC_IN_SEC *
+                dsp_parse_double_argument(dsp_get_long_option_argument(v, &x),
+                    "--duration", 0.001, DSP_MAX_DURATION_SECONDS));
+        } else if (dsp_is_long_option(v[x], "--interval")) {
+            sample_interval = (DSP_NSEC_IN_MSEC *
+                dsp_parse_uint_argument(dsp_get_long_option_argument(v, &x),
+                        "--interval", 1, DSP_MAX_SAMPLE_INTERVAL_MS));
+        } else if (dsp_is_long_option(v[x], "--streams")) {
+            stream_count = (unsigned int)
+                dsp_parse_uint_argument(dsp_get_long_option_argument(v, &x),
+                        "--streams", 1, DSP_MAX_STREAMS);
         } else if (dsp_are_strings_equal(v[x], "-n") ||
                 dsp_are_strings_equal(v[x], "--unit")) {
             if (!v[x + 1] || v[x + 1][0] == '-') {
@@ -499,6 +1771,9 @@ static void dsp_parse_options(char **v)
                     case 'L':
                         large_test = DSP_TRUE;
                         break;
+                    case 'k':
+                        keep_payload = DSP_TRUE;
+                        break;
                     case 'u':
                         dsp_print_error("`-u' requires an argument");
                         dsp_show_usage(DSP_TRUE);
@@ -575,17 +1850,240 @@ static void dsp_parse_options(char **v)
         }
     }
 
-    if (!small_test && !medium_test && !large_test)
-        medium_test = DSP_TRUE;
-
-    if (!use_bit && !use_byte)
-        use_byte = DSP_TRUE;
+    if (upload) {
+        if (!user_supplied_url || !*user_supplied_url) {
+            dsp_print_error("`--upload' requires `-u'/`--url'");
+            exit(EXIT_FAILURE);
+        }
+        if (keep_payload || segmented) {
+            dsp_print_error("`--upload' and `%s' are mutually exclusive",
+                    (keep_payload) ? "-k'/`--keep" : "--segmented");
+            exit(EXIT_FAILURE);
+        }
+        /* without a size a --duration test sends until time is up */
+        if (!upload_size && !test_duration)
+            upload_size = DSP_DEFAULT_UPLOAD_SIZE;
+    } else if (use_post) {
+        dsp_print_error("`--post' can only be used with `--upload'");
+        exit(EXIT_FAILURE);
+    }
 
-    if (!use_metric && !use_binary)
-        use_metric = DSP_TRUE;
-}
+    if (duplex) {
+        s = (upload) ? "--upload" : (segmented) ? "--segmented" :
+            (keep_payload) ? "-k'/`--keep" :
+            (auto_percent > 0.0) ? "--auto" :
+            (daemon_interval) ? "--daemon" : (live_output) ? "--live" :
+            (show_histogram) ? "--histogram" : NULL;
+        if (s) {
+            dsp_print_error("`--duplex' and `%s' are mutually exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+        if (!duplex_url)
+            duplex_url = user_supplied_url;
+        if (!duplex_url || !*duplex_url) {
+            dsp_print_error("`--duplex' requires a URL to upload to, given "
+                    "to it or with `-u'/`--url'");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-static void dsp_format_size(char *buffer, size_t n, dsp_byte_t bytes)
+    if (sweep) {
+        s = (daemon_interval) ? "--daemon" : (duplex) ? "--duplex" :
+            (live_output) ? "--live" : NULL;
+        if (s) {
+            dsp_print_error("`--sweep' and `%s' are mutually exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+        if (!sweep_values.n_buffer_sizes && !sweep_values.n_rcvbufs &&
+                !sweep_values.n_nodelays && !sweep_values.n_congestions) {
+            sweep_values.buffer_sizes[0] = (16 * DSP_BINARY_KIBI);
+            sweep_values.buffer_sizes[1] = (64 * DSP_BINARY_KIBI);
+            sweep_values.buffer_sizes[2] = (256 * DSP_BINARY_KIBI);
+            sweep_values.buffer_sizes[3] = DSP_BINARY_MEBI;
+            sweep_values.n_buffer_sizes = 4;
+            sweep_values.rcvbufs[0] = DSP_ZERO_BYTES;
+            sweep_values.rcvbufs[1] = (256 * DSP_BINARY_KIBI);
+            sweep_values.rcvbufs[2] = DSP_BINARY_MEBI;
+            sweep_values.rcvbufs[3] = (4 * DSP_BINARY_MEBI);
+            sweep_values.n_rcvbufs = 4;
+        }
+    } else {
+        s = (sweep_values.n_buffer_sizes > 1) ? "--buffer-size" :
+            (sweep_values.n_rcvbufs > 1) ? "--rcvbuf" :
+            (sweep_values.n_nodelays > 1) ? "--nodelay" :
+            (sweep_values.n_congestions > 1) ? "--congestion" : NULL;
+        if (s) {
+            dsp_print_error("`%s' can only be given more than one value "
+                    "with `--sweep'", s);
+            exit(EXIT_FAILURE);
+        }
+        dsp_get_tuning(0, &tuning);
+    }
+
+    if (compare_streams) {
+        s = (http_version) ? "--http" : (multiplex) ? "--multiplex" :
+            (daemon_interval) ? "--daemon" : (duplex) ? "--duplex" :
+            (live_output) ? "--live" : (sweep) ? "--sweep" : NULL;
+        if (s) {
+            dsp_print_error("`--compare-http' and `%s' are mutually "
+                    "exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (repeat_count) {
+        s = (daemon_interval) ? "--daemon" : (duplex) ? "--duplex" :
+            (live_output) ? "--live" : (sweep) ? "--sweep" :
+            (compare_streams) ? "--compare-http" : NULL;
+        if (s) {
+            dsp_print_error("`--repeat' and `%s' are mutually exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+    } else if (repeat_pause) {
+        dsp_print_error("`--pause' can only be used with `--repeat'");
+        exit(EXIT_FAILURE);
+    }
+    if (fresh_connections && !repeat_count && !daemon_interval) {
+        dsp_print_error("`--fresh' can only be used with `--repeat' or "
+                "`--daemon'");
+        exit(EXIT_FAILURE);
+    }
+    if (hash_algorithm) {
+        s = (upload) ? "--upload" : (duplex) ? "--duplex" :
+            (segmented) ? "--segmented" : NULL;
+        if (s) {
+            dsp_print_error("`--hash' and `%s' are mutually exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+        if (expected_digest_size &&
+                (expected_digest_size != dsp_get_digest_size())) {
+            dsp_print_error("`--expect' needs a digest of %u hex digits "
+                    "for `--hash=%s'", (unsigned int)(2 *
+                        dsp_get_digest_size()), dsp_get_hash_name());
+            exit(EXIT_FAILURE);
+        }
+    } else if (expected_digest_size) {
+        dsp_print_error("`--expect' can only be used with `--hash'");
+        exit(EXIT_FAILURE);
+    }
+    if (multiplex) {
+        if (http_version == DSP_HTTP_1_1) {
+            dsp_print_error("`--multiplex' can't be used with `--http=1.1'");
+            exit(EXIT_FAILURE);
+        }
+        if (!http_version)
+            http_version = DSP_HTTP_2;
+    }
+
+#ifndef DSP_HAVE_SOCKET_OPTIONS
+    if (sweep_values.n_rcvbufs) {
+        dsp_print_error("`--rcvbuf' is not supported on this system");
+        exit(EXIT_FAILURE);
+    }
+#endif
+    for (x = 0; x < sweep_values.n_congestions; ++x)
+        dsp_check_congestion(sweep_values.congestions[x]);
+
+    if (!small_test && !medium_test && !large_test)
+        medium_test = DSP_TRUE;
+
+    if (!use_bit && !use_byte)
+        use_byte = DSP_TRUE;
+
+    if (!use_metric && !use_binary)
+        use_metric = DSP_TRUE;
+
+    if (metrics_address) {
+#ifdef DSP_HAVE_SOCKETS
+        if (!daemon_interval) {
+            dsp_print_error("`--metrics' can only be used with `--daemon'");
+            exit(EXIT_FAILURE);
+        }
+#else
+        dsp_print_error("`--metrics' is not supported on this system");
+        exit(EXIT_FAILURE);
+#endif
+    }
+
+    if (serve_address) {
+#ifdef DSP_HAVE_SOCKETS
+        s = (user_supplied_url && *user_supplied_url) ? "-u'/`--url" :
+            (daemon_interval) ? "--daemon" : (upload) ? "--upload" :
+            (duplex) ? "--duplex" : (mirror_list) ? "--mirrors" :
+            (live_output) ? "--live" : (sweep) ? "--sweep" :
+            (compare_streams) ? "--compare-http" :
+            (repeat_count) ? "--repeat" : (hash_algorithm) ? "--hash" :
+            (save_path) ? "--save" : NULL;
+        if (s) {
+            dsp_print_error("`--serve' and `%s' are mutually exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+#else
+        dsp_print_error("`--serve' is not supported on this system");
+        exit(EXIT_FAILURE);
+#endif
+    } else if (serve_rate || serve_delay) {
+        dsp_print_error("`%s' can only be used with `--serve'",
+                (serve_rate) ? "--serve-rate" : "--serve-delay");
+        exit(EXIT_FAILURE);
+    }
+
+#ifndef DSP_HAVE_THREADS
+    if (latency_interval) {
+        dsp_print_error("`--latency' is not supported on this system");
+        exit(EXIT_FAILURE);
+    }
+#endif
+
+    if (mirror_list && user_supplied_url && *user_supplied_url) {
+        dsp_print_error("`--mirrors' and `-u'/`--url' are mutually "
+                "exclusive");
+        exit(EXIT_FAILURE);
+    }
+    if (mirror_sources && !mirror_list) {
+        dsp_print_error("`--sources' can only be used with `--mirrors'");
+        exit(EXIT_FAILURE);
+    }
+    if (!mirror_sources)
+        mirror_sources = 1;
+    /* every source needs a stream of its own */
+    if (stream_count && (stream_count < mirror_sources)) {
+        dsp_print_error("`--sources' can't be more than `--streams'");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!stream_count)
+        stream_count = (segmented) ? DSP_DEFAULT_SEGMENTED_STREAMS : 1;
+    if (stream_count < mirror_sources)
+        stream_count = mirror_sources;
+
+    if (save_path) {
+#ifdef DSP_HAVE_SAVE
+        s = (keep_payload) ? "-k'/`--keep" : (upload) ? "--upload" :
+            (duplex) ? "--duplex" : (daemon_interval) ? "--daemon" :
+            (sweep) ? "--sweep" : (compare_streams) ? "--compare-http" :
+            (repeat_count) ? "--repeat" : NULL;
+        if (s) {
+            dsp_print_error("`--save' and `%s' are mutually exclusive", s);
+            exit(EXIT_FAILURE);
+        }
+        /* streams that each download the whole file can't share one */
+        if ((stream_count > 1) && !segmented) {
+            dsp_print_error("`--save' needs `--segmented' to download over "
+                    "more than one stream");
+            exit(EXIT_FAILURE);
+        }
+#else
+        dsp_print_error("`--save' is not supported on this system");
+        exit(EXIT_FAILURE);
+#endif
+    }
+
+    /* keep stdout a stream of JSON lines */
+    if (live_output && !format_given)
+        output_format = DSP_FORMAT_JSON;
+}
+
+static void dsp_format_size(char *buffer, size_t n, dsp_byte_t bytes)
 {
     dsp_byte_t bits;
 
@@ -595,9 +2093,9 @@ static void dsp_format_size(char *buffer, size_t n, dsp_byte_t bytes)
     switch (unit_option) {
     case DSP_UNIT_OPTION_B: {
         if (use_byte)
-            snprintf(buffer, n, "%lu " DSP_BYTE_SYMBOL, bytes);
+            snprintf(buffer, n, "%llu " DSP_BYTE_SYMBOL, bytes);
         else
-            snprintf(buffer, n, "%lu " DSP_BIT_SYMBOL, bits);
+            snprintf(buffer, n, "%llu " DSP_BIT_SYMBOL, bits);
         break;
     }
 #define __DSP_DIVDBL(__b, __v) (((double)__b) / ((double)__v))
@@ -678,14 +2176,14 @@ static void dsp_format_size(char *buffer, size_t n, dsp_byte_t bytes)
                 ((use_metric && (bytes < DSP_METRIC_KILO)) ||
                  (use_binary && (bytes < DSP_BINARY_KIBI))))
         {
-            snprintf(buffer, n, "%lu " DSP_BYTE_SYMBOL, bytes);
+            snprintf(buffer, n, "%llu " DSP_BYTE_SYMBOL, bytes);
             break;
         }
         if (use_bit &&
                 ((use_metric && (bits < DSP_METRIC_KILO)) ||
                  (use_binary && (bits < DSP_BINARY_KIBI))))
         {
-            snprintf(buffer, n, "%lu " DSP_BIT_SYMBOL, bits);
+            snprintf(buffer, n, "%llu " DSP_BIT_SYMBOL, bits);
             break;
         }
         if (use_byte) {
@@ -712,7 +2210,7 @@ static void dsp_format_size(char *buffer, size_t n, dsp_byte_t bytes)
             }
         } else {
 #undef __DSP_SFMT
-#define __DSP_SFMT(__s, __v) snprintf(buffer, n, "%lu " __s, (bits / __v))
+#define __DSP_SFMT(__s, __v) snprintf(buffer, n, "%llu " __s, (bits / __v))
             if (use_metric) {
                 if ((bits / DSP_METRIC_TERA) > DSP_ZERO_BYTES)
                     __DSP_SFMT(DSP_METRIC_TERABIT_SYMBOL, DSP_METRIC_TERA);
@@ -738,64 +2236,55 @@ static void dsp_format_size(char *buffer, size_t n, dsp_byte_t bytes)
     } /* switch(unit_option) */
 }
 
-static void dsp_format_rate(char *buffer,
-                            size_t n,
-                            dsp_boolean_t for_average,
-                            dsp_byte_t bytes)
+/* a negative `bytes_per_sec' means the rate is not known */
+static void dsp_format_rate(char *buffer, size_t n, double bytes_per_sec)
 {
-    int elapsed;
     size_t x;
-    dsp_byte_t t_bytes;
-
-    if (for_average) {
-        elapsed = (((int)start_time) - ((int)end_time));
-        if (elapsed < 0)
-            elapsed = -elapsed;
-        t_bytes = (bytes / ((dsp_byte_t)elapsed));
-        dsp_format_size(buffer, DSP_SIZE_BUFFER_SIZE, t_bytes);
-    } else
-        dsp_format_size(buffer, DSP_SIZE_BUFFER_SIZE, bytes);
+
+    buffer[0] = '\0';
+    if (bytes_per_sec < 0.0)
+        return;
+
+    dsp_format_size(buffer, n, ((dsp_byte_t)(bytes_per_sec + 0.5)));
 
     if (*buffer) {
         x = strlen(buffer);
-        buffer[x++] = '/';
-        buffer[x++] = 's';
-        buffer[x] = '\0';
+        if ((x + 2) < n) {
+            buffer[x++] = '/';
+            buffer[x++] = 's';
+            buffer[x] = '\0';
+        }
     }
 }
 
-static void dsp_format_time(char *buffer, size_t n)
+static void dsp_format_time(char *buffer, size_t n, dsp_nsec_t elapsed)
 {
-    int elapsed;
     int days;
     int hours;
     int minutes;
-    int seconds;
+    double seconds;
     size_t x;
 
-    elapsed = (((int)start_time) - ((int)end_time));
-    if (elapsed < 0)
-        elapsed = -elapsed;
-
-    days = (elapsed / DSP_SECONDS_IN_DAY);
-    hours = (elapsed / DSP_SECONDS_IN_HOUR);
-    minutes = (elapsed / DSP_SECONDS_IN_MINUTE);
-    seconds = (elapsed % DSP_MOD_VALUE_FOR_SECONDS);
+    days = (int)(elapsed / (DSP_NSEC_IN_SEC * DSP_SECONDS_IN_DAY));
+    hours = (int)((elapsed / (DSP_NSEC_IN_SEC * DSP_SECONDS_IN_HOUR)) %
+            DSP_HOURS_IN_DAY);
+    minutes = (int)((elapsed / (DSP_NSEC_IN_SEC * DSP_SECONDS_IN_MINUTE)) %
+            DSP_MOD_VALUE_FOR_SECONDS);
+    seconds = (((double)(elapsed % (DSP_NSEC_IN_SEC *
+                        DSP_MOD_VALUE_FOR_SECONDS))) /
+            ((double)DSP_NSEC_IN_SEC));
+    buffer[0] = '\0';
     x = 0;
 
     if (days > 0) {
         snprintf(buffer, n, "%i day%s", days, (days == 1) ? "" : "s");
         x = strlen(buffer);
-        if ((hours == 0) && (minutes == 0) && (seconds == 0))
-            return;
     }
 
     if (hours > 0) {
-        snprintf(buffer, n, "%s%i hour%s",
+        snprintf(buffer + x, n - x, "%s%i hour%s",
                 (days > 0) ? " " : "", hours, (hours == 1) ? "" : "s");
         x = strlen(buffer);
-        if ((minutes == 0) && (seconds == 0))
-            return;
     }
 
     if (minutes > 0) {
@@ -803,14 +2292,11 @@ static void dsp_format_time(char *buffer, size_t n)
                 ((days > 0) || (hours > 0)) ? " " : "",
                 minutes, (minutes == 1) ? "" : "s");
         x = strlen(buffer);
-        if (seconds == 0)
-            return;
     }
 
-    if (seconds > 0)
-        snprintf(buffer + x, n - x, "%s%i second%s",
-                ((days > 0) || (hours > 0) || (minutes > 0)) ? " " : "",
-                seconds, (seconds == 1) ? "" : "s");
+    if ((seconds >= 0.005) || (x == 0))
+        snprintf(buffer + x, n - x, "%s%.2f seconds",
+                (x > 0) ? " " : "", seconds);
 }
 
 static void dsp_format_date(char *buffer, size_t n)
@@ -827,7 +2313,7 @@ static void dsp_format_date(char *buffer, size_t n)
     strftime(buffer, n, "%Y-%m-%d", t);
 }
 
-static void dsp_format_temp_filename(char *buffer, size_t n)
+static void dsp_format_temp_filename(char *buffer, size_t n, unsigned int id)
 {
     unsigned int random;
     char *test_name;
@@ -845,18 +2331,8 @@ static void dsp_format_temp_filename(char *buffer, size_t n)
     else
         test_name = "large";
 
-    snprintf(buffer, n, ".%s_%s-test_%s_%u",
-            DSP_DEFAULT_PROGRAM_NAME, test_name, date, random);
-}
-
-static dsp_boolean_t dsp_is_nan_value(double v)
-{
-    volatile double x;
-
-    x = v;
-    if (x != x)
-        return DSP_TRUE;
-    return DSP_FALSE;
+    snprintf(buffer, n, ".%s_%s-test_%s_%u_%u",
+            DSP_DEFAULT_PROGRAM_NAME, test_name, date, random, id);
 }
 
 static int dsp_get_console_width(void)
@@ -883,357 +2359,6173 @@ static int dsp_get_console_width(void)
     return width;
 }
 
+/*
+ * Return the time of the monotonic clock in nanoseconds. It has
+ * no meaning by itself and is only used to measure time passing.
+ */
+static dsp_nsec_t dsp_get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count;
+    static LARGE_INTEGER frequency;
+
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&count);
+    return ((dsp_nsec_t)((((double)count.QuadPart) /
+                    ((double)frequency.QuadPart)) * DSP_NSEC_IN_SEC));
+#else
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return DSP_ZERO_NSEC;
+    return ((((dsp_nsec_t)ts.tv_sec) * DSP_NSEC_IN_SEC) +
+            ((dsp_nsec_t)ts.tv_nsec));
+#endif
+}
+
+/* the processor time used so far by all of dsp, or zero if unknown */
+static dsp_nsec_t dsp_get_cpu_time(void)
+{
+#ifdef _WIN32
+    FILETIME creation;
+    FILETIME exited;
+    FILETIME kernel;
+    FILETIME user;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel,
+                &user))
+        return DSP_ZERO_NSEC;
+    /* in units of 100 nanoseconds */
+    return (((((dsp_nsec_t)kernel.dwHighDateTime) << 32) +
+                ((dsp_nsec_t)kernel.dwLowDateTime) +
+                (((dsp_nsec_t)user.dwHighDateTime) << 32) +
+                ((dsp_nsec_t)user.dwLowDateTime)) * 100);
+#elif defined(HAVE_SYS_RESOURCE_H)
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return DSP_ZERO_NSEC;
+    return (((((dsp_nsec_t)ru.ru_utime.tv_sec) +
+                    ((dsp_nsec_t)ru.ru_stime.tv_sec)) * DSP_NSEC_IN_SEC) +
+            ((((dsp_nsec_t)ru.ru_utime.tv_usec) +
+              ((dsp_nsec_t)ru.ru_stime.tv_usec)) * 1000));
+#else
+    return DSP_ZERO_NSEC;
+#endif
+}
+
+static double dsp_nsec_to_sec(dsp_nsec_t t)
+{
+    return (((double)t) / ((double)DSP_NSEC_IN_SEC));
+}
+
+static dsp_nsec_t dsp_sec_to_nsec(double secs)
+{
+    return (secs > 0.0) ? ((dsp_nsec_t)((secs * DSP_NSEC_IN_SEC) + 0.5)) :
+        DSP_ZERO_NSEC;
+}
+
+/* average rate of `bytes' over `elapsed', or -1 if no time passed */
+static double dsp_get_rate(dsp_byte_t bytes, dsp_nsec_t elapsed)
+{
+    if (!elapsed)
+        return -1.0;
+    return (((double)bytes) / dsp_nsec_to_sec(elapsed));
+}
+
+/*
+ * Records where a stream is at, the display and the samples are
+ * taken care of by the loop in dsp_run_streams(). With --duration
+ * this is also where every transfer gets stopped once time is up.
+ */
+#if LIBCURL_VERSION_NUM >= 0x072000
+static int dsp_progress_callback(void *data,
+                                 curl_off_t d_total,
+                                 curl_off_t d_current,
+                                 curl_off_t u_total,
+                                 curl_off_t u_current)
+#else
 static int dsp_progress_callback(void *data,
                                  double d_total,
                                  double d_current,
                                  double u_total,
                                  double u_current)
+#endif
 {
-    static time_t last_time = -1;
-    static dsp_byte_t last_bytes = DSP_ZERO_BYTES;
-    static dsp_boolean_t one_sec_passed = DSP_FALSE;
-
-    int i;
-    int j;
-    int days_remaining;
-    int hours_remaining;
-    int minutes_remaining;
-    int seconds_remaining;
-    int console_width;
-    double x;
-    double elapsed;
-    time_t now_time;
-    dsp_byte_t now_bytes;
-    dsp_byte_t bytes_this_sec;
-
-    if (!total_bytes && (d_total > 0.0))
-        total_bytes = ((dsp_byte_t)d_total);
-
-    now_time = -1;
-    elapsed = -1.0;
-
-    if (last_time) {
-        now_time = time(NULL);
-        elapsed = (((double)now_time) - ((double)last_time));
-        if (elapsed >= 1) {
-            one_sec_passed = DSP_TRUE;
-            now_bytes = ((dsp_byte_t)d_current);
-            if (last_bytes == DSP_ZERO_BYTES)
-                last_bytes = now_bytes;
-            else if (now_bytes > last_bytes) {
-                bytes_this_sec = (now_bytes - last_bytes);
-                if (bytes_this_sec) {
-                    if (bytes_this_sec > most_bytes_per_sec)
-                        most_bytes_per_sec = bytes_this_sec;
-                    if ((least_bytes_per_sec == DSP_ZERO_BYTES) ||
-                            (bytes_this_sec < least_bytes_per_sec))
-                        least_bytes_per_sec = bytes_this_sec;
-                }
-            }
-            last_time = now_time;
-            last_bytes = now_bytes;
-        } else
-            one_sec_passed = DSP_FALSE;
-    } else
-        last_time = time(NULL);
-
-    console_width = dsp_get_console_width();
-
-    fputs("Calculating... (", stdout);
-    console_width -= strlen("Calculating... (");
-
-    x = (d_current / d_total);
-    j = 0;
-
-    if (dsp_is_nan_value(x) || dsp_is_nan_value((x * 100))) {
-        putchar('0');
-        j = 1;
+    dsp_nsec_t now_time;
+    struct dsp_stream *s;
+
+    ++client_cost.progress_callbacks;
+    s = (struct dsp_stream *)data;
+    if (s->sending) {
+        s->d_total = (dsp_byte_t)u_total;
+        s->d_current = (dsp_byte_t)u_current;
     } else {
-        printf("%.0f", (x * 100));
-        if ((x * 100) < 10)
-            j = 1;
-        else if ((x * 100) < 100)
-            j = 2;
-        else
-            j = 3;
+        s->d_total = (dsp_byte_t)d_total;
+        s->d_current = (dsp_byte_t)d_current;
     }
 
-    console_width -= j;
-    fputs("%)", stdout);
-    console_width -= 2;
-
-    if (one_sec_passed && elapsed && (d_total > d_current)) {
-        if (j == 1) {
-            fputs("   ", stdout);
-            console_width -= 3;
-        } else if (j == 2) {
-            fputs("  ", stdout);
-            console_width -= 2;
-        } else {
-            putchar(' ');
-            console_width -= 1;
-        }
-        i = (d_current / (now_time - start_time));
-        if (i < 0)
-            i = -i;
-        days_remaining =
-            (((int)((d_total - d_current) / i)) / DSP_SECONDS_IN_DAY);
-        hours_remaining =
-            (((int)((d_total - d_current) / i)) / DSP_SECONDS_IN_HOUR);
-        minutes_remaining =
-            (((int)((d_total - d_current) / i)) / DSP_SECONDS_IN_MINUTE);
-        seconds_remaining =
-            (((int)((d_total - d_current) / i)) % DSP_MOD_VALUE_FOR_SECONDS);
-        if (days_remaining > 0)
-            console_width -=
-                printf("%i day%s", days_remaining,
-                        (days_remaining == 1) ? "" : "s");
-        if (hours_remaining > 0)
-            console_width -=
-                printf("%s%i hour%s",
-                        (days_remaining > 0) ? " " : "",
-                        hours_remaining,
-                        (hours_remaining == 1) ? "" : "s");
-        if (minutes_remaining > 0)
-            console_width -=
-                printf("%s%i minute%s",
-                        ((days_remaining > 0) ||
-                         (hours_remaining > 0)) ? " " : "",
-                        minutes_remaining,
-                        (minutes_remaining == 1) ? "" : "s");
-        if (seconds_remaining > 0)
-            console_width -=
-                printf("%s%i second%s",
-                        ((days_remaining > 0) || (hours_remaining > 0) ||
-                         (minutes_remaining > 0)) ? " " : "",
-                        seconds_remaining,
-                        (seconds_remaining == 1) ? "" : "s");
-        for (j = 0; j < console_width; ++j)
-            putchar(' ');
-    }
-
-    console_width = dsp_get_console_width();
-    if ((d_current == d_total) && (d_current > 0.0) && (d_total > 0.0)) {
-        putchar('\r');
-        for (i = 0; i < console_width; ++i)
-            putchar(' ');
-    }
-
-    putchar('\r');
-    fflush(stdout);
-    return 0;
+    if (test_duration && !stop_time) {
+        now_time = dsp_get_time();
+        if ((now_time - start_time) >= test_duration)
+            stop_time = now_time;
+    }
+    return (stop_time || daemon_stopping) ? 1 : 0;
 }
 
-static void dsp_set_temp_file_path(void)
+static void dsp_series_add(struct dsp_series *ds,
+                           dsp_nsec_t t,
+                           dsp_byte_t bytes)
 {
-    size_t n;
-    size_t n_home;
-    char *home;
-    char name[DSP_TEMP_FILENAME_BUFFER_SIZE];
-
-    dsp_format_temp_filename(name, DSP_TEMP_FILENAME_BUFFER_SIZE);
-    n = strlen(name);
+    size_t capacity;
+    struct dsp_sample *samples;
 
-    home = DSP_GETENV_HOME;
-    if (home && *home) {
-        n_home = strlen(home);
-        temp_file_path = (char *)malloc(n + n_home + 2);
-        if (temp_file_path)
-            snprintf(temp_file_path, n + n_home + 2, "%s%c%s",
-                    home, DSP_PATH_SEPARATOR_CHAR, name);
-        else
-            goto try_current_directory;
-    } else
-        goto try_current_directory;
+    if (ds->count && (ds->samples[ds->count - 1].t >= t))
+        return;
 
-    return;
+    if (ds->count == ds->capacity) {
+        capacity = (ds->capacity) ? (ds->capacity * 2) :
+            DSP_INITIAL_SERIES_CAPACITY;
+        samples = (struct dsp_sample *)realloc(ds->samples,
+                capacity * sizeof(struct dsp_sample));
+        if (!samples) {
+            dsp_print_error(strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        ds->samples = samples;
+        ds->capacity = capacity;
+    }
 
-try_current_directory:
-    temp_file_path = (char *)malloc(n + 1);
-    if (temp_file_path) {
-        strncpy(temp_file_path, name, n);
-        temp_file_path[n] = '\0';
-    } else
-        dsp_print_error(strerror(errno));
-    return;
+    ds->samples[ds->count].t = t;
+    ds->samples[ds->count].bytes = bytes;
+    ++ds->count;
 }
 
-static dsp_boolean_t dsp_setup_curl(CURL **cp, FILE **fp)
+static void dsp_series_free(struct dsp_series *ds)
 {
-    int s_errno;
-    CURLcode c_status;
-    const char *url;
-
-    c_status = CURLE_OK;
-    *cp = curl_easy_init();
+    free(ds->samples);
+    ds->samples = NULL;
+    ds->count = 0;
+    ds->capacity = 0;
+}
 
-    if (!*cp) {
-        c_status = CURLE_FAILED_INIT;
-        goto failure;
+/*
+ * Find the highest and lowest rates over the intervals of a series.
+ * The intervals up to and including the one the first data arrived
+ * in are left out since they include the time spent connecting, and
+ * so are intervals where nothing arrived at all.
+ */
+static void dsp_series_get_peak_and_lowest(const struct dsp_series *ds,
+                                           dsp_byte_t *most,
+                                           dsp_byte_t *least)
+{
+    size_t x;
+    dsp_byte_t rate;
+    const struct dsp_sample *a;
+    const struct dsp_sample *b;
+
+    *most = DSP_ZERO_BYTES;
+    *least = DSP_ZERO_BYTES;
+
+    for (x = 1; x < ds->count; ++x) {
+        a = &ds->samples[x - 1];
+        b = &ds->samples[x];
+        if ((a->bytes == DSP_ZERO_BYTES) || (b->bytes <= a->bytes))
+            continue;
+        rate = ((dsp_byte_t)dsp_get_rate(b->bytes - a->bytes, b->t - a->t));
+        if (!rate)
+            continue;
+        if (rate > *most)
+            *most = rate;
+        if ((*least == DSP_ZERO_BYTES) || (rate < *least))
+            *least = rate;
     }
+}
 
-    if (user_supplied_url && *user_supplied_url)
-        url = user_supplied_url;
-    else if (small_test)
-        url = DSP_DEFAULT_URL_SMALL;
-    else if (medium_test)
-        url = DSP_DEFAULT_URL_MEDIUM;
-    else if (large_test)
-        url = DSP_DEFAULT_URL_LARGE;
-    else
-        url = NULL;
-
-    c_status = curl_easy_setopt(*cp, CURLOPT_URL, url);
-    if (c_status != CURLE_OK)
-        goto failure;
+/*
+ * Find the sample the steady state of a series starts at: either the
+ * first one after --warmup=SECONDS, or the first window (counted from
+ * when data started arriving) that the window after it is not
+ * noticeably faster than. Returns DSP_FALSE if there is none, for
+ * example when the whole test was spent ramping up.
+ */
+static dsp_boolean_t dsp_series_find_steady_start(const struct dsp_series *ds,
+                                                  size_t *start)
+{
+    size_t x;
+    size_t w;
+    double a;
+    double b;
+    const struct dsp_sample *smp;
+
+    smp = ds->samples;
+
+    /* --warmup=0 leaves nothing out */
+    if (warmup_given) {
+        for (x = 0; x < ds->count; ++x) {
+            if (smp[x].t >= warmup_time)
+                break;
+        }
+        if ((x + 1) >= ds->count)
+            return DSP_FALSE;
+        *start = x;
+        return DSP_TRUE;
+    }
 
-    c_status = curl_easy_setopt(*cp, CURLOPT_USERAGENT, DSP_USER_AGENT);
-    if (c_status != CURLE_OK)
-        goto failure;
+    for (x = 0; (x < ds->count) && (smp[x].bytes == DSP_ZERO_BYTES); ++x)
+        ;
+    if (x > 0)
+        --x;
+
+    w = (size_t)((DSP_STEADY_STATE_WINDOW_MS * DSP_NSEC_IN_MSEC) /
+            sample_interval);
+    if (w < 2)
+        w = 2;
+
+    for (; (x + (w * 2)) < ds->count; ++x) {
+        a = dsp_get_rate(smp[x + w].bytes - smp[x].bytes,
+                smp[x + w].t - smp[x].t);
+        b = dsp_get_rate(smp[x + (w * 2)].bytes - smp[x + w].bytes,
+                smp[x + (w * 2)].t - smp[x + w].t);
+        if ((a > 0.0) && (b <= (a * (1.0 + DSP_STEADY_STATE_SLOPE)))) {
+            *start = x;
+            return DSP_TRUE;
+        }
+    }
+    return DSP_FALSE;
+}
 
-    c_status = curl_easy_setopt(*cp, CURLOPT_FOLLOWLOCATION, 1L);
-    if (c_status != CURLE_OK)
-        goto failure;
+static void dsp_stats_add(struct dsp_stats *st, double bytes, double secs)
+{
+    size_t x;
 
-    dsp_set_temp_file_path();
-    if (!temp_file_path || !*temp_file_path) {
-        curl_easy_cleanup(*cp);
-        return DSP_FALSE;
+    if (st->pending) {
+        st->intervals[st->count - 1].bytes += (float)bytes;
+        st->intervals[st->count - 1].secs += (float)secs;
+    } else {
+        if (st->count == DSP_STATS_CAPACITY) {
+            for (x = 0; x < (DSP_STATS_CAPACITY / 2); ++x) {
+                st->intervals[x].bytes = (st->intervals[x * 2].bytes +
+                        st->intervals[(x * 2) + 1].bytes);
+                st->intervals[x].secs = (st->intervals[x * 2].secs +
+                        st->intervals[(x * 2) + 1].secs);
+            }
+            st->count = (DSP_STATS_CAPACITY / 2);
+            st->stride *= 2;
+        }
+        st->intervals[st->count].bytes = (float)bytes;
+        st->intervals[st->count].secs = (float)secs;
+        ++st->count;
     }
 
-    *fp = fopen(temp_file_path, "w+b");
-    if (!*fp) {
-        s_errno = errno;
-        dsp_print_error(strerror(s_errno));
-        curl_easy_cleanup(*cp);
-        return DSP_FALSE;
-    }
+    if (++st->pending == st->stride)
+        st->pending = 0;
+}
 
-    c_status = curl_easy_setopt(*cp, CURLOPT_WRITEDATA, (void *)*fp);
-    if (c_status != CURLE_OK)
-        goto failure;
+static int dsp_compare_doubles(const void *a, const void *b)
+{
+    double x;
+    double y;
 
-    c_status = curl_easy_setopt(*cp, CURLOPT_WRITEFUNCTION, (void *)fwrite);
-    if (c_status != CURLE_OK)
-        goto failure;
+    x = *((const double *)a);
+    y = *((const double *)b);
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
 
-    c_status = curl_easy_setopt(*cp, CURLOPT_NOPROGRESS, 0L);
-    if (c_status != CURLE_OK)
-        goto failure;
+/* returns a sorted copy of the interval rates, which the caller frees */
+static double *dsp_stats_get_sorted_rates(const struct dsp_stats *st)
+{
+    size_t x;
+    double *rates;
 
-    c_status =
-        curl_easy_setopt(*cp, CURLOPT_PROGRESSFUNCTION,
-                (void *)dsp_progress_callback);
-    if (c_status != CURLE_OK)
-        goto failure;
+    if (!st->count)
+        return NULL;
 
-    return DSP_TRUE;
+    rates = (double *)malloc(st->count * sizeof(double));
+    if (!rates) {
+        dsp_print_error(strerror(errno));
+        return NULL;
+    }
 
-failure:
-    dsp_print_error(curl_easy_strerror(c_status));
-    if (*fp)
-        fclose(*fp);
-    curl_easy_cleanup(*cp);
-    return DSP_FALSE;
+    for (x = 0; x < st->count; ++x)
+        rates[x] = (st->intervals[x].secs > 0.0f) ?
+            (((double)st->intervals[x].bytes) /
+             ((double)st->intervals[x].secs)) : 0.0;
+    qsort(rates, st->count, sizeof(double), dsp_compare_doubles);
+    return rates;
 }
 
-static void dsp_fill_display_data(void)
+/* a sorted copy of the round-trip times of `p' in seconds, which the
+   caller frees */
+static double *dsp_probes_get_sorted_rtts(const struct dsp_probes *p)
 {
-    display_data.total_down_size[0] = '\0';
-    display_data.total_down_time[0] = '\0';
-    display_data.average_down_rate[0] = '\0';
-    display_data.peak_down_rate[0] = '\0';
-    display_data.lowest_down_rate[0] = '\0';
+    size_t x;
+    double *rtts;
+
+    if (!p->count)
+        return NULL;
 
-    dsp_format_size(display_data.total_down_size, DSP_SIZE_BUFFER_SIZE,
-            total_bytes);
-    dsp_format_time(display_data.total_down_time, DSP_TIME_BUFFER_SIZE);
-    dsp_format_rate(display_data.average_down_rate, DSP_SPEED_BUFFER_SIZE,
-            DSP_TRUE, total_bytes);
-    dsp_format_rate(display_data.peak_down_rate, DSP_SPEED_BUFFER_SIZE,
-            DSP_FALSE, most_bytes_per_sec);
-    dsp_format_rate(display_data.lowest_down_rate, DSP_SPEED_BUFFER_SIZE,
-            DSP_FALSE, least_bytes_per_sec);
+    rtts = (double *)malloc(p->count * sizeof(double));
+    if (!rtts) {
+        dsp_print_error(strerror(errno));
+        return NULL;
+    }
+    for (x = 0; x < p->count; ++x)
+        rtts[x] = dsp_nsec_to_sec(p->rtts[x]);
+    qsort(rtts, p->count, sizeof(double), dsp_compare_doubles);
+    return rtts;
 }
 
-static void dsp_show_display_data(void)
+/* linear interpolation between the closest ranks of sorted `rates' */
+static double dsp_get_percentile(const double *rates, size_t n, double p)
 {
-    fputs(DSP_TOTAL_DOWN_TIME_DISPLAY_TAG, stdout);
-    if (*display_data.total_down_time)
-        puts(display_data.total_down_time);
-    else
-        puts(DSP_UNKNOWN_DISPLAY_DATA);
-
-    fputs(DSP_TOTAL_DOWN_SIZE_DISPLAY_TAG, stdout);
-    if (*display_data.total_down_size)
-        puts(display_data.total_down_size);
-    else
-        puts(DSP_UNKNOWN_DISPLAY_DATA);
+    size_t i;
+    double rank;
+
+    if (n == 1)
+        return rates[0];
+    rank = ((p / 100.0) * ((double)(n - 1)));
+    i = (size_t)rank;
+    if (i >= (n - 1))
+        return rates[n - 1];
+    return (rates[i] + ((rank - ((double)i)) * (rates[i + 1] - rates[i])));
+}
 
-    fputs(DSP_AVERAGE_DOWN_RATE_DISPLAY_TAG, stdout);
-    if (*display_data.average_down_rate)
-        puts(display_data.average_down_rate);
-    else
-        puts(DSP_UNKNOWN_DISPLAY_DATA);
+static void dsp_get_mean_and_stddev(const double *rates,
+                                    size_t n,
+                                    double *mean,
+                                    double *stddev)
+{
+    size_t x;
+    double sum;
 
-    fputs(DSP_PEAK_DOWN_RATE_DISPLAY_TAG, stdout);
-    if (*display_data.peak_down_rate)
-        puts(display_data.peak_down_rate);
-    else
-        puts(DSP_UNKNOWN_DISPLAY_DATA);
+    sum = 0.0;
+    for (x = 0; x < n; ++x)
+        sum += rates[x];
+    *mean = (sum / ((double)n));
 
-    fputs(DSP_LOWEST_DOWN_RATE_DISPLAY_TAG, stdout);
-    if (*display_data.lowest_down_rate)
-        puts(display_data.lowest_down_rate);
-    else
-        puts(DSP_UNKNOWN_DISPLAY_DATA);
+    sum = 0.0;
+    for (x = 0; x < n; ++x)
+        sum += ((rates[x] - *mean) * (rates[x] - *mean));
+    *stddev = (n > 1) ? sqrt(sum / ((double)(n - 1))) : 0.0;
 }
 
-static void dsp_perform(void)
+/* the two-sided 95% critical value of Student's t with `df' degrees
+   of freedom, the normal one corrected for `df' past the table */
+static double dsp_get_t_critical(size_t df)
 {
-    FILE *fp;
-    CURL *cp;
-    CURLcode c_status;
+    static const double t[DSP_T_CRITICAL_MAX_DF] = DSP_T_CRITICAL;
 
-    fp = NULL;
-    cp = NULL;
+    if (df <= DSP_T_CRITICAL_MAX_DF)
+        return t[df - 1];
+    return (DSP_CONFIDENCE_Z + (((DSP_CONFIDENCE_Z * DSP_CONFIDENCE_Z *
+                        DSP_CONFIDENCE_Z) + DSP_CONFIDENCE_Z) /
+                (4.0 * ((double)df))));
+}
 
-    if (!dsp_setup_curl(&cp, &fp))
-        exit(EXIT_FAILURE);
+/* the mean, median and 95% confidence interval of the mean of the `n'
+   `values', which are sorted */
+static void dsp_summarize(double *values, size_t n, struct dsp_summary *s)
+{
+    double stddev;
 
-    start_time = time(NULL);
-    c_status = curl_easy_perform(cp);
-    end_time = time(NULL);
+    s->n = n;
+    s->mean = -1.0;
+    s->median = -1.0;
+    s->half_width = -1.0;
+    if (!n)
+        return;
+    qsort(values, n, sizeof(double), dsp_compare_doubles);
+    dsp_get_mean_and_stddev(values, n, &s->mean, &stddev);
+    s->median = dsp_get_percentile(values, n, 50.0);
+    if (n > 1)
+        s->half_width = (dsp_get_t_critical(n - 1) * stddev /
+                sqrt((double)n));
+}
 
-    if (fp)
-        fclose(fp);
+static void dsp_estimate_add(struct dsp_estimate *e, double rate)
+{
+    double delta;
 
-    if (c_status != CURLE_OK) {
-        dsp_print_error(curl_easy_strerror(c_status));
-        curl_easy_cleanup(cp);
-        exit(EXIT_FAILURE);
-    }
+    ++e->n;
+    delta = (rate - e->mean);
+    e->mean += (delta / ((double)e->n));
+    e->m2 += (delta * (rate - e->mean));
+}
 
-    curl_easy_cleanup(cp);
-    dsp_fill_display_data();
-    dsp_show_display_data();
+/* half the width of the 95% confidence interval of the mean */
+static double dsp_estimate_get_half_width(const struct dsp_estimate *e)
+{
+    if (e->n < 2)
+        return -1.0;
+    return (DSP_CONFIDENCE_Z *
+            sqrt((e->m2 / ((double)(e->n - 1))) / ((double)e->n)));
 }
 
-static void dsp_cleanup(void)
+/* add a sample of where every unfinished stream and the aggregate are */
+static void dsp_record_samples(dsp_nsec_t now_time)
 {
-    if (temp_file_path) {
-        if (!DSP_DELETE_FILE(temp_file_path))
+    unsigned int x;
+    size_t n;
+    dsp_byte_t bytes[2];
+    const struct dsp_sample *a;
+    const struct dsp_sample *b;
+
+    bytes[0] = DSP_ZERO_BYTES;
+    bytes[1] = DSP_ZERO_BYTES;
+    for (x = 0; x < stream_count; ++x) {
+        if (!streams[x].end_time)
+            dsp_series_add(&streams[x].series, now_time - start_time,
+                    streams[x].total_bytes);
+        bytes[(streams[x].sending) ? 1 : 0] += streams[x].total_bytes;
+    }
+    if (duplex) {
+        dsp_series_add(&duplex_series[0], now_time - start_time, bytes[0]);
+        dsp_series_add(&duplex_series[1], now_time - start_time, bytes[1]);
+    }
+
+    n = download_series.count;
+    dsp_series_add(&download_series, now_time - start_time, total_bytes);
+    if ((n == 0) || (download_series.count == n))
+        return;
+
+    /* same intervals as dsp_series_get_peak_and_lowest() but keeping
+       the stalls, leaving out the short one the test ended in */
+    a = &download_series.samples[n - 1];
+    b = &download_series.samples[n];
+    if ((a->bytes == DSP_ZERO_BYTES) || ((b->t - a->t) < (sample_interval / 2)))
+        return;
+    dsp_stats_add(&download_stats, (double)(b->bytes - a->bytes),
+            dsp_nsec_to_sec(b->t - a->t));
+
+    if (auto_percent <= 0.0)
+        return;
+    dsp_estimate_add(&download_estimate,
+            dsp_get_rate(b->bytes - a->bytes, b->t - a->t));
+    /* the progress callbacks stop the transfers from here on */
+    if (!stop_time && (download_estimate.n >= DSP_AUTO_MIN_SAMPLES) &&
+            (download_estimate.mean > 0.0) &&
+            (dsp_estimate_get_half_width(&download_estimate) <=
+             (download_estimate.mean * (auto_percent / 100.0))))
+        stop_time = now_time;
+}
+
+/* the time the test is expected to take from here on, or -1 */
+static double dsp_get_eta(dsp_nsec_t now_time)
+{
+    unsigned int x;
+    double total;
+    double rate;
+
+    if (test_duration)
+        return (test_duration > (now_time - start_time)) ?
+            dsp_nsec_to_sec(test_duration - (now_time - start_time)) : 0.0;
+
+    total = 0.0;
+    if (segmented)
+        total = ((double)object_size);
+    else
+        for (x = 0; x < stream_count; ++x)
+            total += ((double)streams[x].d_total);
+
+    rate = dsp_get_rate(total_bytes, now_time - start_time);
+    if ((total <= 0.0) || (rate <= 0.0))
+        return -1.0;
+    return (total > ((double)total_bytes)) ?
+        ((total - ((double)total_bytes)) / rate) : 0.0;
+}
+
+#ifdef SIGWINCH
+static void dsp_handle_resize_signal(int signum)
+{
+    console_resized = 1;
+}
+#endif
+
+/* only draw the progress display on a terminal, and only ask for its
+   width again when it changes */
+static void dsp_init_progress(void)
+{
+    if ((output_format != DSP_FORMAT_TEXT) || live_output)
+        return;
+#ifdef _WIN32
+    progress.enabled = (_isatty(_fileno(stdout))) ? DSP_TRUE : DSP_FALSE;
+#elif defined(HAVE_UNISTD_H)
+    progress.enabled = (isatty(STDOUT_FILENO)) ? DSP_TRUE : DSP_FALSE;
+#endif
+    if (!progress.enabled)
+        return;
+    progress.width = dsp_get_console_width();
+#ifdef SIGWINCH
+    signal(SIGWINCH, dsp_handle_resize_signal);
+#endif
+}
+
+/* write the first `n' bytes of the progress line in one go */
+static void dsp_write_progress(size_t n)
+{
+#ifdef HAVE_UNISTD_H
+    size_t x;
+    ssize_t written;
+
+    for (x = 0; x < n; x += ((size_t)written)) {
+        written = write(STDOUT_FILENO, progress.line + x, n - x);
+        if (written < 0) {
+            if (errno == EINTR) {
+                written = 0;
+                continue;
+            }
+            return;
+        }
+    }
+#else
+    fwrite(progress.line, 1, n, stdout);
+    fflush(stdout);
+#endif
+}
+
+/*
+ * Draw the progress display, at most DSP_PROGRESS_FRAME_RATE times a
+ * second. The line is padded to the width of the console and put
+ * together before it is written, so each frame costs a single write.
+ */
+static void dsp_show_progress(dsp_nsec_t now_time)
+{
+    int n;
+    int width;
+    unsigned int x;
+    unsigned long secs;
+    unsigned long days;
+    unsigned long hours;
+    unsigned long minutes;
+    double eta;
+    double done;
+    double total;
+    double current;
+
+    if (!progress.enabled || (progress.drawn &&
+                ((now_time - progress.drawn) <
+                 (DSP_NSEC_IN_SEC / DSP_PROGRESS_FRAME_RATE))))
+        return;
+    /* anything printf() still holds goes out ahead of the display */
+    if (!progress.drawn)
+        fflush(stdout);
+    progress.drawn = now_time;
+    if (console_resized) {
+        console_resized = 0;
+        progress.width = dsp_get_console_width();
+    }
+    width = progress.width;
+    if (width >= DSP_PROGRESS_LINE_SIZE)
+        width = (DSP_PROGRESS_LINE_SIZE - 1);
+
+    total = 0.0;
+    current = 0.0;
+    if (test_duration) {
+        /* in seconds, which gives the time left rather than a guess */
+        total = dsp_nsec_to_sec(test_duration);
+        current = dsp_nsec_to_sec(now_time - start_time);
+        if (current > total)
+            current = total;
+    } else if (segmented) {
+        total = ((double)object_size);
+        current = ((double)total_bytes);
+    } else {
+        for (x = 0; x < stream_count; ++x) {
+            total += ((double)streams[x].d_total);
+            current += ((double)streams[x].d_current);
+        }
+    }
+    done = (total > 0.0) ? ((current * 100.0) / total) : 0.0;
+
+    n = snprintf(progress.line, DSP_PROGRESS_LINE_SIZE,
+            "Calculating... (%.0f%%)", done);
+
+    eta = dsp_get_eta(now_time);
+    if (((now_time - start_time) >= DSP_NSEC_IN_SEC) && (eta >= 1.0) &&
+            (current < total)) {
+        /* the time left starts in the same column whatever the share */
+        n += snprintf(progress.line + n, DSP_PROGRESS_LINE_SIZE - n, "%*s",
+                (done < 10.0) ? 3 : ((done < 100.0) ? 2 : 1), "");
+        secs = (unsigned long)eta;
+        days = (secs / DSP_SECONDS_IN_DAY);
+        hours = ((secs / DSP_SECONDS_IN_HOUR) % DSP_HOURS_IN_DAY);
+        minutes = ((secs / DSP_SECONDS_IN_MINUTE) % DSP_MOD_VALUE_FOR_SECONDS);
+        secs %= DSP_MOD_VALUE_FOR_SECONDS;
+        if (days)
+            n += snprintf(progress.line + n, DSP_PROGRESS_LINE_SIZE - n,
+                    "%lu day%s ", days, (days == 1) ? "" : "s");
+        if (hours)
+            n += snprintf(progress.line + n, DSP_PROGRESS_LINE_SIZE - n,
+                    "%lu hour%s ", hours, (hours == 1) ? "" : "s");
+        if (minutes)
+            n += snprintf(progress.line + n, DSP_PROGRESS_LINE_SIZE - n,
+                    "%lu minute%s ", minutes, (minutes == 1) ? "" : "s");
+        if (secs)
+            n += snprintf(progress.line + n, DSP_PROGRESS_LINE_SIZE - n,
+                    "%lu second%s ", secs, (secs == 1) ? "" : "s");
+    }
+
+    /* the last column is left alone so the terminal doesn't wrap */
+    if (n > (width - 1))
+        n = (width > 1) ? (width - 1) : 0;
+    while (n < (width - 1))
+        progress.line[n++] = ' ';
+    progress.line[n++] = '\r';
+    dsp_write_progress((size_t)n);
+}
+
+/* blank out the progress display once a test is over */
+static void dsp_clear_progress(void)
+{
+    int n;
+    int width;
+
+    if (!progress.enabled || !progress.drawn)
+        return;
+    progress.drawn = DSP_ZERO_NSEC;
+    width = progress.width;
+    if (width >= DSP_PROGRESS_LINE_SIZE)
+        width = (DSP_PROGRESS_LINE_SIZE - 1);
+    for (n = 0; n < (width - 1); ++n)
+        progress.line[n] = ' ';
+    progress.line[n++] = '\r';
+    dsp_write_progress((size_t)n);
+}
+
+/*
+ * With --segmented, return how many of the `n' bytes just received
+ * belong to the stream's range. Anything past the end of the range
+ * (which may have been handed to another stream in the meantime) is
+ * refused, and libcurl then stops the transfer.
+ */
+static size_t dsp_clip_to_range(struct dsp_stream *s, size_t n)
+{
+    long code;
+
+    if (!segmented)
+        return n;
+
+    if (!s->range_checked) {
+        code = 0;
+        curl_easy_getinfo(s->cp, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 206) {
+            dsp_print_error("server ignored the range request "
+                    "(HTTP status %ld)", code);
+            return 0;
+        }
+        s->range_checked = DSP_TRUE;
+    }
+
+    if ((s->range_pos + ((dsp_byte_t)n)) > (s->range_end + 1)) {
+        n = (size_t)((s->range_end + 1) - s->range_pos);
+        s->range_done = DSP_TRUE;
+    }
+    s->range_pos += ((dsp_byte_t)n);
+    if (s->range_pos > s->range_end)
+        s->range_done = DSP_TRUE;
+    return n;
+}
+
+/*
+ * --hash: CRC-32C and SHA-256 of what each stream receives, worked out
+ * in the write callback as the data goes by. Both have a portable
+ * version and one for x86 processors with SSE4.2 (CRC-32C) and the SHA
+ * extensions (SHA-256), which dsp_init_hash() picks at run time.
+ */
+/* {{{ */
+static const uint32_t dsp_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t dsp_sha256_h[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+    0x1f83d9ab, 0x5be0cd19
+};
+
+/* slice-by-8 tables of the portable CRC-32C, made by dsp_init_hash() */
+uint32_t crc32c_table[8][256];
+
+/* the versions dsp_init_hash() picked, and their names */
+uint32_t (*dsp_crc32c_update)(uint32_t, const unsigned char *, size_t);
+void (*dsp_sha256_blocks)(uint32_t *, const unsigned char *, size_t);
+const char *hash_implementation = "portable";
+
+/* CRC-32C of `n' bytes at `p' eight at a time, `crc' being inverted */
+static uint32_t dsp_crc32c_portable(uint32_t crc,
+                                    const unsigned char *p,
+                                    size_t n)
+{
+    while (n && (((size_t)p) & 7)) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        --n;
+    }
+    while (n >= 8) {
+        crc ^= ((uint32_t)p[0]) | (((uint32_t)p[1]) << 8) |
+            (((uint32_t)p[2]) << 16) | (((uint32_t)p[3]) << 24);
+        crc = crc32c_table[7][crc & 0xff] ^
+            crc32c_table[6][(crc >> 8) & 0xff] ^
+            crc32c_table[5][(crc >> 16) & 0xff] ^
+            crc32c_table[4][crc >> 24] ^
+            crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+            crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#define DSP_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* run SHA-256 over the `n' 64 byte blocks at `p' */
+static void dsp_sha256_portable(uint32_t *state,
+                                const unsigned char *p,
+                                size_t n)
+{
+    size_t x;
+    uint32_t w[64];
+    uint32_t v[8];
+    uint32_t t1;
+    uint32_t t2;
+
+    for (; n; --n, p += 64) {
+        for (x = 0; x < 16; ++x)
+            w[x] = (((uint32_t)p[x * 4]) << 24) |
+                (((uint32_t)p[(x * 4) + 1]) << 16) |
+                (((uint32_t)p[(x * 4) + 2]) << 8) | ((uint32_t)p[(x * 4) + 3]);
+        for (x = 16; x < 64; ++x)
+            w[x] = w[x - 16] + w[x - 7] +
+                (DSP_ROTR32(w[x - 15], 7) ^ DSP_ROTR32(w[x - 15], 18) ^
+                 (w[x - 15] >> 3)) +
+                (DSP_ROTR32(w[x - 2], 17) ^ DSP_ROTR32(w[x - 2], 19) ^
+                 (w[x - 2] >> 10));
+        memcpy(v, state, sizeof(v));
+        for (x = 0; x < 64; ++x) {
+            t1 = v[7] + (DSP_ROTR32(v[4], 6) ^ DSP_ROTR32(v[4], 11) ^
+                    DSP_ROTR32(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+                dsp_sha256_k[x] + w[x];
+            t2 = (DSP_ROTR32(v[0], 2) ^ DSP_ROTR32(v[0], 13) ^
+                    DSP_ROTR32(v[0], 22)) +
+                ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = v[3] + t1;
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = t1 + t2;
+        }
+        for (x = 0; x < 8; ++x)
+            state[x] += v[x];
+    }
+}
+
+#ifdef DSP_HAVE_X86_HASH
+/*
+ * Operators that append zeros to a CRC-32C, for combining the three
+ * CRCs that dsp_crc32c_sse42() works out side by side (the crc32
+ * instruction can start one every cycle but takes three to finish).
+ * Each is a table per byte of the CRC, made from the matrix over GF(2)
+ * that appends a run of zeros, squared up from one zero bit.
+ */
+#define DSP_CRC32C_LONG  4096
+#define DSP_CRC32C_SHORT  256
+
+uint32_t crc32c_long[4][256];
+uint32_t crc32c_short[4][256];
+
+static uint32_t dsp_gf2_times(const uint32_t *matrix, uint32_t vector)
+{
+    uint32_t sum;
+
+    for (sum = 0; vector; vector >>= 1, ++matrix) {
+        if (vector & 1)
+            sum ^= *matrix;
+    }
+    return sum;
+}
+
+static void dsp_gf2_square(uint32_t *square, const uint32_t *matrix)
+{
+    size_t x;
+
+    for (x = 0; x < 32; ++x)
+        square[x] = dsp_gf2_times(matrix, matrix[x]);
+}
+
+/* the tables that append `n' (a power of two) zero bytes */
+static void dsp_crc32c_make_zeros(uint32_t zeros[4][256], size_t n)
+{
+    size_t x;
+    uint32_t odd[32];
+    uint32_t even[32];
+
+    /* one zero bit, then two and four */
+    odd[0] = 0x82f63b78;
+    for (x = 1; x < 32; ++x)
+        odd[x] = ((uint32_t)1) << (x - 1);
+    dsp_gf2_square(even, odd);
+    dsp_gf2_square(odd, even);
+    /* one zero byte, then doubled until there are `n' */
+    for (;;) {
+        dsp_gf2_square(even, odd);
+        n >>= 1;
+        if (!n) {
+            memcpy(odd, even, sizeof(odd));
+            break;
+        }
+        dsp_gf2_square(odd, even);
+        n >>= 1;
+        if (!n)
+            break;
+    }
+    for (x = 0; x < 256; ++x) {
+        zeros[0][x] = dsp_gf2_times(odd, (uint32_t)x);
+        zeros[1][x] = dsp_gf2_times(odd, ((uint32_t)x) << 8);
+        zeros[2][x] = dsp_gf2_times(odd, ((uint32_t)x) << 16);
+        zeros[3][x] = dsp_gf2_times(odd, ((uint32_t)x) << 24);
+    }
+}
+
+static uint32_t dsp_crc32c_shift(uint32_t zeros[4][256], uint32_t crc)
+{
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+        zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+/* the crc32 instruction takes eight bytes at a time on x86-64 */
+# ifdef __x86_64__
+#  define DSP_CRC32C_WORD          uint64_t
+#  define DSP_CRC32C_STEP(crc, p)  _mm_crc32_u64((crc), dsp_load_word(p))
+# else
+#  define DSP_CRC32C_WORD          uint32_t
+#  define DSP_CRC32C_STEP(crc, p)  _mm_crc32_u32((crc), dsp_load_word(p))
+# endif
+
+static DSP_CRC32C_WORD dsp_load_word(const unsigned char *p)
+{
+    DSP_CRC32C_WORD v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* dsp_crc32c_portable() with the crc32 instruction of SSE4.2, three
+   CRCs at a time over blocks of DSP_CRC32C_LONG and then _SHORT */
+__attribute__((target("sse4.2")))
+static uint32_t dsp_crc32c_sse42(uint32_t crc,
+                                 const unsigned char *p,
+                                 size_t n)
+{
+    const unsigned char *end;
+    DSP_CRC32C_WORD crc0;
+    DSP_CRC32C_WORD crc1;
+    DSP_CRC32C_WORD crc2;
+
+    while (n && (((size_t)p) & (sizeof(DSP_CRC32C_WORD) - 1))) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --n;
+    }
+    crc0 = crc;
+    while (n >= (DSP_CRC32C_LONG * 3)) {
+        crc1 = 0;
+        crc2 = 0;
+        for (end = p + DSP_CRC32C_LONG; p < end;
+                p += sizeof(DSP_CRC32C_WORD)) {
+            crc0 = DSP_CRC32C_STEP(crc0, p);
+            crc1 = DSP_CRC32C_STEP(crc1, p + DSP_CRC32C_LONG);
+            crc2 = DSP_CRC32C_STEP(crc2, p + (DSP_CRC32C_LONG * 2));
+        }
+        crc0 = dsp_crc32c_shift(crc32c_long, (uint32_t)crc0) ^ crc1;
+        crc0 = dsp_crc32c_shift(crc32c_long, (uint32_t)crc0) ^ crc2;
+        p += (DSP_CRC32C_LONG * 2);
+        n -= (DSP_CRC32C_LONG * 3);
+    }
+    while (n >= (DSP_CRC32C_SHORT * 3)) {
+        crc1 = 0;
+        crc2 = 0;
+        for (end = p + DSP_CRC32C_SHORT; p < end;
+                p += sizeof(DSP_CRC32C_WORD)) {
+            crc0 = DSP_CRC32C_STEP(crc0, p);
+            crc1 = DSP_CRC32C_STEP(crc1, p + DSP_CRC32C_SHORT);
+            crc2 = DSP_CRC32C_STEP(crc2, p + (DSP_CRC32C_SHORT * 2));
+        }
+        crc0 = dsp_crc32c_shift(crc32c_short, (uint32_t)crc0) ^ crc1;
+        crc0 = dsp_crc32c_shift(crc32c_short, (uint32_t)crc0) ^ crc2;
+        p += (DSP_CRC32C_SHORT * 2);
+        n -= (DSP_CRC32C_SHORT * 3);
+    }
+    while (n >= sizeof(DSP_CRC32C_WORD)) {
+        crc0 = DSP_CRC32C_STEP(crc0, p);
+        p += sizeof(DSP_CRC32C_WORD);
+        n -= sizeof(DSP_CRC32C_WORD);
+    }
+    crc = (uint32_t)crc0;
+    while (n--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+/*
+ * dsp_sha256_portable() with the SHA extensions, which keep the state
+ * as ABEF and CDGH and do two rounds (sha256rnds2) and the message
+ * schedule (sha256msg1 and sha256msg2) four words at a time. `w' holds
+ * the four latest groups of four words of the schedule.
+ */
+__attribute__((target("sha,sse4.1")))
+static void dsp_sha256_shani(uint32_t *state,
+                             const unsigned char *p,
+                             size_t n)
+{
+    size_t x;
+    __m128i w[4];
+    __m128i msg;
+    __m128i tmp;
+    __m128i state0;
+    __m128i state1;
+    __m128i abef;
+    __m128i cdgh;
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bLL,
+            0x0405060700010203LL);
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]),
+            0xb1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]),
+            0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (; n; --n, p += 64) {
+        abef = state0;
+        cdgh = state1;
+        for (x = 0; x < 16; ++x) {
+            if (x < 4)
+                w[x] = _mm_shuffle_epi8(_mm_loadu_si128(
+                            (const __m128i *)(p + (x * 16))), mask);
+            msg = _mm_add_epi32(w[x & 3],
+                    _mm_loadu_si128((const __m128i *)&dsp_sha256_k[x * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if ((x >= 3) && (x <= 14)) {
+                tmp = _mm_alignr_epi8(w[x & 3], w[(x - 1) & 3], 4);
+                w[(x + 1) & 3] = _mm_sha256msg2_epu32(
+                        _mm_add_epi32(w[(x + 1) & 3], tmp), w[x & 3]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if ((x >= 1) && (x <= 12))
+                w[(x - 1) & 3] = _mm_sha256msg1_epu32(w[(x - 1) & 3],
+                        w[x & 3]);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+#endif
+
+/* make the tables and pick the fastest versions the processor can run */
+static void dsp_init_hash(void)
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t crc;
+#ifdef DSP_HAVE_X86_HASH
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+#endif
+
+    for (x = 0; x < 256; ++x) {
+        crc = x;
+        for (y = 0; y < 8; ++y)
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x82f63b78) : (crc >> 1);
+        crc32c_table[0][x] = crc;
+    }
+    for (x = 0; x < 256; ++x) {
+        crc = crc32c_table[0][x];
+        for (y = 1; y < 8; ++y) {
+            crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            crc32c_table[y][x] = crc;
+        }
+    }
+    dsp_crc32c_update = dsp_crc32c_portable;
+    dsp_sha256_blocks = dsp_sha256_portable;
+
+#ifdef DSP_HAVE_X86_HASH
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return;
+    /* SSE4.2 */
+    if ((hash_algorithm == DSP_HASH_CRC32C) && (ecx & (1U << 20))) {
+        dsp_crc32c_make_zeros(crc32c_long, DSP_CRC32C_LONG);
+        dsp_crc32c_make_zeros(crc32c_short, DSP_CRC32C_SHORT);
+        dsp_crc32c_update = dsp_crc32c_sse42;
+        hash_implementation = "SSE4.2";
+    }
+    /* SHA (leaf 7) needs SSSE3 and SSE4.1 too */
+    if ((hash_algorithm == DSP_HASH_SHA256) && (ecx & (1U << 9)) &&
+            (ecx & (1U << 19)) && (__get_cpuid_max(0, NULL) >= 7)) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (ebx & (1U << 29)) {
+            dsp_sha256_blocks = dsp_sha256_shani;
+            hash_implementation = "SHA-NI";
+        }
+    }
+#endif
+}
+
+static void dsp_hash_reset(struct dsp_hash *h)
+{
+    h->crc = 0xffffffff;
+    memcpy(h->state, dsp_sha256_h, sizeof(h->state));
+    h->used = 0;
+    h->length = DSP_ZERO_BYTES;
+}
+
+static void dsp_hash_update(struct dsp_hash *h,
+                            const unsigned char *p,
+                            size_t n)
+{
+    size_t x;
+
+    if (hash_algorithm == DSP_HASH_CRC32C) {
+        h->crc = dsp_crc32c_update(h->crc, p, n);
+        return;
+    }
+
+    h->length += (dsp_byte_t)n;
+    if (h->used) {
+        x = (64 - h->used);
+        if (x > n)
+            x = n;
+        memcpy(h->block + h->used, p, x);
+        h->used += x;
+        p += x;
+        n -= x;
+        if (h->used < 64)
+            return;
+        dsp_sha256_blocks(h->state, h->block, 1);
+        h->used = 0;
+    }
+    if (n >= 64) {
+        dsp_sha256_blocks(h->state, p, n / 64);
+        p += (n & ~((size_t)63));
+        n &= 63;
+    }
+    memcpy(h->block, p, n);
+    h->used = n;
+}
+
+/* the digest of all that went into `h' (which it uses up), big-endian */
+static void dsp_hash_final(struct dsp_hash *h, unsigned char *digest)
+{
+    size_t x;
+    dsp_byte_t bits;
+
+    if (hash_algorithm == DSP_HASH_CRC32C) {
+        h->crc ^= 0xffffffff;
+        for (x = 0; x < 4; ++x)
+            digest[x] = (unsigned char)(h->crc >> (24 - (x * 8)));
+        return;
+    }
+
+    bits = (h->length * 8);
+    h->block[h->used++] = 0x80;
+    if (h->used > 56) {
+        memset(h->block + h->used, 0, 64 - h->used);
+        dsp_sha256_blocks(h->state, h->block, 1);
+        h->used = 0;
+    }
+    memset(h->block + h->used, 0, 56 - h->used);
+    for (x = 0; x < 8; ++x)
+        h->block[56 + x] = (unsigned char)(bits >> (56 - (x * 8)));
+    dsp_sha256_blocks(h->state, h->block, 1);
+    for (x = 0; x < 32; ++x)
+        digest[x] = (unsigned char)(h->state[x / 4] >> (24 - ((x % 4) * 8)));
+}
+/* }}} */
+
+/* a digest of `hash_algorithm' in lowercase hex */
+static void dsp_format_digest(char *buffer, const unsigned char *digest)
+{
+    size_t x;
+
+    for (x = 0; x < dsp_get_digest_size(); ++x)
+        sprintf(buffer + (x * 2), "%02x", (unsigned int)digest[x]);
+}
+
+/*
+ * The digest of the test: that of the streams that downloaded the whole
+ * file, in `*complete'. NULL if there were none or if they don't agree,
+ * as streams that all got the same URL should.
+ */
+static const unsigned char *dsp_get_test_digest(unsigned int *complete)
+{
+    unsigned int x;
+    const unsigned char *digest;
+
+    digest = NULL;
+    *complete = 0;
+    for (x = 0; x < stream_count; ++x) {
+        if (!streams[x].hashed)
+            continue;
+        ++*complete;
+        if (!digest)
+            digest = streams[x].digest;
+        else if (memcmp(digest, streams[x].digest, dsp_get_digest_size()))
+            return NULL;
+    }
+    return digest;
+}
+
+/* every stream has to have downloaded a file with the --expect digest */
+static dsp_boolean_t dsp_check_digests(void)
+{
+    unsigned int x;
+    char got[DSP_DIGEST_BUFFER_SIZE];
+    char want[DSP_DIGEST_BUFFER_SIZE];
+
+    dsp_format_digest(want, expected_digest);
+    for (x = 0; x < stream_count; ++x) {
+        if (!streams[x].hashed) {
+            dsp_print_error("stream %u: the test ended before the whole "
+                    "file was downloaded, so it can't be checked",
+                    streams[x].id + 1);
+            return DSP_FALSE;
+        }
+        if (memcmp(streams[x].digest, expected_digest,
+                    expected_digest_size)) {
+            dsp_format_digest(got, streams[x].digest);
+            dsp_print_error("stream %u: the %s of the file is %s, "
+                    "expected %s", streams[x].id + 1,
+                    (hash_algorithm == DSP_HASH_SHA256) ? "SHA-256" :
+                    "CRC-32C", got, want);
+            return DSP_FALSE;
+        }
+    }
+    return DSP_TRUE;
+}
+
+/* the default sink: data is only counted and never leaves memory */
+static size_t dsp_discard_callback(char *ptr,
+                                   size_t size,
+                                   size_t nmemb,
+                                   void *data)
+{
+    size_t n;
+    struct dsp_stream *s;
+
+    ++client_cost.data_callbacks;
+    s = (struct dsp_stream *)data;
+    /* the whole file is hashed, even what comes after a stop */
+    if (hash_algorithm)
+        dsp_hash_update(&s->hash, (const unsigned char *)ptr, size * nmemb);
+    /* anything arriving after the test was stopped doesn't count */
+    if (stop_time)
+        return (size * nmemb);
+
+    n = dsp_clip_to_range(s, (size * nmemb));
+    s->total_bytes += ((dsp_byte_t)n);
+    total_bytes += ((dsp_byte_t)n);
+    return n;
+}
+
+/* used instead of dsp_discard_callback() when `--keep' is given */
+static size_t dsp_file_write_callback(char *ptr,
+                                      size_t size,
+                                      size_t nmemb,
+                                      void *data)
+{
+    size_t n;
+    struct dsp_stream *s;
+
+    ++client_cost.data_callbacks;
+    s = (struct dsp_stream *)data;
+    if (hash_algorithm)
+        dsp_hash_update(&s->hash, (const unsigned char *)ptr, size * nmemb);
+    if (stop_time)
+        return (size * nmemb);
+
+#ifndef DSP_HAVE_RANGE_FILE
+    if (segmented) {
+# ifdef HAVE_FSEEKO
+        if (fseeko(s->fp, (off_t)s->range_pos, SEEK_SET) != 0)
+            return 0;
+# else
+        if (fseek(s->fp, (long)s->range_pos, SEEK_SET) != 0)
+            return 0;
+# endif
+    }
+#endif
+    n = dsp_clip_to_range(s, (size * nmemb));
+    n = fwrite(ptr, 1, n, s->fp);
+    s->total_bytes += ((dsp_byte_t)n);
+    total_bytes += ((dsp_byte_t)n);
+    return n;
+}
+
+#ifdef DSP_HAVE_RANGE_FILE
+/* used instead with `--segmented': each stream writes its range into
+   the one file at the offset it came from, without seeking */
+static size_t dsp_range_write_callback(char *ptr,
+                                       size_t size,
+                                       size_t nmemb,
+                                       void *data)
+{
+    size_t n;
+    size_t done;
+    ssize_t written;
+    dsp_byte_t pos;
+    struct dsp_stream *s;
+
+    ++client_cost.data_callbacks;
+    s = (struct dsp_stream *)data;
+    if (hash_algorithm)
+        dsp_hash_update(&s->hash, (const unsigned char *)ptr, size * nmemb);
+    if (stop_time)
+        return (size * nmemb);
+
+    pos = s->range_pos;
+    n = dsp_clip_to_range(s, (size * nmemb));
+    for (done = 0; done < n; done += ((size_t)written)) {
+        written = pwrite(range_file_fd, ptr + done, n - done,
+                (off_t)(pos + done));
+        if (written > 0)
+            continue;
+        if ((written < 0) && (errno == EINTR)) {
+            written = 0;
+            continue;
+        }
+        break;
+    }
+    s->total_bytes += ((dsp_byte_t)done);
+    total_bytes += ((dsp_byte_t)done);
+    return done;
+}
+#endif
+
+#ifdef DSP_HAVE_SAVE
+/*
+ * Write one --save buffer where it belongs in the file: as much of it
+ * as starts and ends on a DSP_SAVE_ALIGNMENT boundary with O_DIRECT,
+ * the rest (the ends of a range) through the page cache. Returns 0 or
+ * the errno of the failed write. Only the writer thread calls it.
+ */
+static int dsp_write_save_buffer(const struct dsp_save_buffer *b)
+{
+    int fd;
+    size_t n;
+    size_t done;
+    size_t aligned;
+    ssize_t written;
+
+    aligned = 0;
+    if (save_file.direct && !(b->offset % DSP_SAVE_ALIGNMENT))
+        aligned = (b->length - (b->length % DSP_SAVE_ALIGNMENT));
+
+    for (done = 0; done < b->length; done += ((size_t)written)) {
+        fd = (done < aligned) ? save_file.fd : save_file.tail_fd;
+        n = ((done < aligned) ? aligned : b->length) - done;
+        written = pwrite(fd, b->data + done, n, (off_t)(b->offset + done));
+        if (written > 0)
+            continue;
+        /* nothing written and no error would only be tried forever */
+        if (!written)
+            return ENOSPC;
+        written = 0;
+        if (errno == EINTR)
+            continue;
+        /* a file system that needs bigger blocks than we align to */
+        if ((errno == EINVAL) && (fd != save_file.tail_fd)) {
+            save_file.direct = DSP_FALSE;
+            aligned = done;
+            continue;
+        }
+        return errno;
+    }
+    return 0;
+}
+
+/* give the --save file its whole size up front, where the file system
+   can do it without writing it */
+static void dsp_preallocate_save_file(dsp_byte_t size)
+{
+#ifdef HAVE_FALLOCATE
+    if (fallocate(save_file.fd, 0, 0, (off_t)size) == 0)
+        save_file.preallocated = DSP_TRUE;
+#endif
+}
+
+/* writes the buffers on the --save queue until dsp_stop_save() */
+static void *dsp_save_thread(void *data)
+{
+    int rc;
+    int error;
+    dsp_nsec_t t;
+    dsp_byte_t size_hint;
+    struct dsp_save_buffer *b;
+
+    pthread_mutex_lock(&save_lock);
+    for (;;) {
+        while (!save_file.queue && !save_file.stopping)
+            pthread_cond_wait(&save_wake, &save_lock);
+        b = save_file.queue;
+        if (!b)
+            break;
+        save_file.queue = b->next;
+        save_file.writing = DSP_TRUE;
+        error = save_file.error;
+        size_hint = save_file.size_hint;
+        save_file.size_hint = DSP_ZERO_BYTES;
+        pthread_mutex_unlock(&save_lock);
+
+        /* after a failed write the rest are only given back */
+        rc = 0;
+        t = dsp_get_time();
+        if (!error) {
+            if (size_hint)
+                dsp_preallocate_save_file(size_hint);
+            rc = dsp_write_save_buffer(b);
+        }
+        t = (dsp_get_time() - t);
+
+        pthread_mutex_lock(&save_lock);
+        save_file.write_time += t;
+        if (rc && !save_file.error)
+            save_file.error = rc;
+        if (!error && !rc) {
+            save_file.bytes += ((dsp_byte_t)b->length);
+            if ((b->offset + b->length) > save_file.end)
+                save_file.end = (b->offset + b->length);
+        }
+        save_file.writing = DSP_FALSE;
+        b->next = save_file.spare;
+        save_file.spare = b;
+        pthread_cond_broadcast(&save_done);
+    }
+    pthread_mutex_unlock(&save_lock);
+    return NULL;
+}
+
+/* a buffer to fill, waiting for the writer thread to finish one if
+   there is none to spare. NULL if writing the file failed */
+static struct dsp_save_buffer *dsp_get_save_buffer(void)
+{
+    dsp_nsec_t t;
+    struct dsp_save_buffer *b;
+
+    pthread_mutex_lock(&save_lock);
+    if (!save_file.spare && !save_file.error) {
+        t = dsp_get_time();
+        while (!save_file.spare && !save_file.error)
+            pthread_cond_wait(&save_done, &save_lock);
+        save_file.stall_time += (dsp_get_time() - t);
+    }
+    b = (save_file.error) ? NULL : save_file.spare;
+    if (b)
+        save_file.spare = b->next;
+    pthread_mutex_unlock(&save_lock);
+    return b;
+}
+
+static void dsp_queue_save_buffer(struct dsp_save_buffer *b)
+{
+    pthread_mutex_lock(&save_lock);
+    b->next = NULL;
+    if (save_file.queue)
+        save_file.queue_tail->next = b;
+    else
+        save_file.queue = b;
+    save_file.queue_tail = b;
+    pthread_cond_signal(&save_wake);
+    pthread_mutex_unlock(&save_lock);
+}
+
+/* how big the file will be, for the writer thread to preallocate it */
+static void dsp_set_save_size_hint(dsp_byte_t size)
+{
+    pthread_mutex_lock(&save_lock);
+    save_file.size_hint = size;
+    pthread_mutex_unlock(&save_lock);
+}
+
+/*
+ * Copy `n' bytes a stream received for `offset' of the file into its
+ * buffer. A buffer is queued once it reaches a multiple of
+ * DSP_SAVE_BUFFER_SIZE in the file, so every buffer but the first and
+ * last of a range starts and ends aligned and is written with O_DIRECT.
+ */
+static dsp_boolean_t dsp_save_data(struct dsp_stream *s,
+                                   dsp_byte_t offset,
+                                   const char *ptr,
+                                   size_t n)
+{
+    size_t room;
+    struct dsp_save_buffer *b;
+
+    while (n) {
+        b = s->save_buffer;
+        /* a --segmented stream that took over part of another range */
+        if (b && ((b->offset + b->length) != offset)) {
+            dsp_queue_save_buffer(b);
+            b = NULL;
+        }
+        if (!b) {
+            b = dsp_get_save_buffer();
+            if (!b) {
+                s->save_buffer = NULL;
+                return DSP_FALSE;
+            }
+            b->offset = offset;
+            b->length = 0;
+        }
+
+        room = (DSP_SAVE_BUFFER_SIZE -
+                ((size_t)(b->offset % DSP_SAVE_BUFFER_SIZE)) - b->length);
+        if (room > n)
+            room = n;
+        memcpy(b->data + b->length, ptr, room);
+        b->length += room;
+        offset += ((dsp_byte_t)room);
+        ptr += room;
+        n -= room;
+
+        if ((b->offset + b->length) % DSP_SAVE_BUFFER_SIZE)
+            s->save_buffer = b;
+        else {
+            dsp_queue_save_buffer(b);
+            s->save_buffer = NULL;
+        }
+    }
+    return DSP_TRUE;
+}
+
+/* used instead of dsp_discard_callback() when `--save' is given */
+static size_t dsp_save_callback(char *ptr,
+                                size_t size,
+                                size_t nmemb,
+                                void *data)
+{
+    size_t n;
+    dsp_byte_t offset;
+    curl_off_t length;
+    struct dsp_stream *s;
+
+    ++client_cost.data_callbacks;
+    s = (struct dsp_stream *)data;
+    if (hash_algorithm)
+        dsp_hash_update(&s->hash, (const unsigned char *)ptr, size * nmemb);
+    if (stop_time)
+        return (size * nmemb);
+
+    if (segmented)
+        offset = s->range_pos;
+    else {
+        offset = s->total_bytes;
+        if (!offset) {
+            length = -1;
+            curl_easy_getinfo(s->cp, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                    &length);
+            if (length > 0)
+                dsp_set_save_size_hint((dsp_byte_t)length);
+        }
+    }
+    n = dsp_clip_to_range(s, (size * nmemb));
+    if (!dsp_save_data(s, offset, ptr, n))
+        return 0;
+    s->total_bytes += ((dsp_byte_t)n);
+    total_bytes += ((dsp_byte_t)n);
+    return n;
+}
+#endif
+
+/* with --upload, whatever the server answers is neither kept nor counted */
+static size_t dsp_response_callback(char *ptr,
+                                    size_t size,
+                                    size_t nmemb,
+                                    void *data)
+{
+    return (size * nmemb);
+}
+
+/*
+ * Hand libcurl the next part of a stream's --upload, copied out of
+ * `upload_buffer' from where the stream is at. Counted like received
+ * data is by dsp_discard_callback(), so the rates are those of the
+ * data given to the connection.
+ */
+static size_t dsp_upload_read_callback(char *ptr,
+                                       size_t size,
+                                       size_t nmemb,
+                                       void *data)
+{
+    size_t n;
+    size_t x;
+    size_t pos;
+    size_t chunk;
+    struct dsp_stream *s;
+
+    ++client_cost.data_callbacks;
+    if (stop_time || daemon_stopping)
+        return CURL_READFUNC_ABORT;
+
+    s = (struct dsp_stream *)data;
+    n = (size * nmemb);
+    if (upload_size && (((dsp_byte_t)n) > (upload_size - s->total_bytes)))
+        n = (size_t)(upload_size - s->total_bytes);
+
+    for (x = 0; x < n; x += chunk) {
+        pos = (size_t)((s->total_bytes + x) % DSP_UPLOAD_BUFFER_SIZE);
+        chunk = DSP_UPLOAD_BUFFER_SIZE - pos;
+        if (chunk > (n - x))
+            chunk = n - x;
+        memcpy(ptr + x, upload_buffer + pos, chunk);
+    }
+    s->total_bytes += ((dsp_byte_t)n);
+    total_bytes += ((dsp_byte_t)n);
+    return n;
+}
+
+static char *dsp_make_temp_file_path(unsigned int id)
+{
+    size_t n;
+    size_t n_home;
+    char *home;
+    char *path;
+    char name[DSP_TEMP_FILENAME_BUFFER_SIZE];
+
+    dsp_format_temp_filename(name, DSP_TEMP_FILENAME_BUFFER_SIZE, id);
+    n = strlen(name);
+
+    home = DSP_GETENV_HOME;
+    if (home && *home) {
+        n_home = strlen(home);
+        path = (char *)malloc(n + n_home + 2);
+        if (path) {
+            snprintf(path, n + n_home + 2, "%s%c%s",
+                    home, DSP_PATH_SEPARATOR_CHAR, name);
+            return path;
+        }
+    }
+
+    path = (char *)malloc(n + 1);
+    if (path) {
+        strncpy(path, name, n);
+        path[n] = '\0';
+    } else
+        dsp_print_error(strerror(errno));
+    return path;
+}
+
+#ifdef DSP_HAVE_RANGE_FILE
+/* the first stream makes the file that all of the ranges go into */
+static dsp_boolean_t dsp_open_range_file(struct dsp_stream *s)
+{
+    s->temp_file_path = dsp_make_temp_file_path(s->id);
+    if (!s->temp_file_path || !*s->temp_file_path)
+        return DSP_FALSE;
+    range_file_fd = open(s->temp_file_path, O_RDWR | O_CREAT | O_TRUNC,
+            0666);
+    if (range_file_fd < 0) {
+        dsp_print_error(strerror(errno));
+        return DSP_FALSE;
+    }
+    return DSP_TRUE;
+}
+
+/* give the file the size of the object once it is known, so that the
+   ranges are written into it rather than each making it longer */
+static dsp_boolean_t dsp_size_range_file(void)
+{
+#ifdef HAVE_FALLOCATE
+    if (fallocate(range_file_fd, 0, 0, (off_t)object_size) == 0)
+        return DSP_TRUE;
+#endif
+    if (ftruncate(range_file_fd, (off_t)object_size) == 0)
+        return DSP_TRUE;
+    dsp_print_error(strerror(errno));
+    return DSP_FALSE;
+}
+#endif
+
+static const char *dsp_get_url(void)
+{
+    if (object_url)
+        return object_url;
+    if (user_supplied_url && *user_supplied_url)
+        return user_supplied_url;
+    if (mirror_count && mirrors[0].used)
+        return mirrors[0].url;
+    if (small_test)
+        return DSP_DEFAULT_URL_SMALL;
+    if (medium_test)
+        return DSP_DEFAULT_URL_MEDIUM;
+    if (large_test)
+        return DSP_DEFAULT_URL_LARGE;
+    return NULL;
+}
+
+/* where stream `s' goes: --duplex uploads and --sources have their own */
+static const char *dsp_get_stream_url(const struct dsp_stream *s)
+{
+    if (s->sending && duplex)
+        return duplex_url;
+    if (s->url)
+        return s->url;
+    return dsp_get_url();
+}
+
+static CURLcode dsp_set_stream_range(struct dsp_stream *s)
+{
+    char range[DSP_RANGE_BUFFER_SIZE];
+
+    snprintf(range, DSP_RANGE_BUFFER_SIZE, "%llu-%llu", s->range_pos,
+            s->range_end);
+    s->range_checked = DSP_FALSE;
+    s->range_done = DSP_FALSE;
+    return curl_easy_setopt(s->cp, CURLOPT_RANGE, range);
+}
+
+static size_t dsp_accept_ranges_callback(char *ptr,
+                                         size_t size,
+                                         size_t nmemb,
+                                         void *data)
+{
+    size_t n;
+    char *v;
+
+    n = (size * nmemb);
+    if ((n > 14) && dsp_does_string_start_with_nocase(ptr, "accept-ranges:")) {
+        for (v = (ptr + 14); (v < (ptr + n)) && ((*v == ' ') || (*v == '\t'));
+                ++v)
+            ;
+        if ((((ptr + n) - v) >= 5) && dsp_does_string_start_with_nocase(v,
+                    "bytes"))
+            *((dsp_boolean_t *)data) = DSP_TRUE;
+    }
+    return n;
+}
+
+/*
+ * Ask the server for the size of the file with a HEAD request and
+ * make sure it supports byte ranges. The URL the request ended up at
+ * (after redirects) is used for all the range requests after this.
+ */
+static dsp_boolean_t dsp_discover_object(void)
+{
+    dsp_boolean_t accepts_ranges;
+    char *url;
+    CURL *cp;
+    CURLcode c_status;
+    curl_off_t size;
+
+    accepts_ranges = DSP_FALSE;
+    size = -1;
+    url = NULL;
+
+    cp = curl_easy_init();
+    if (!cp) {
+        dsp_print_error(curl_easy_strerror(CURLE_FAILED_INIT));
+        return DSP_FALSE;
+    }
+
+    curl_easy_setopt(cp, CURLOPT_URL, dsp_get_url());
+    curl_easy_setopt(cp, CURLOPT_USERAGENT, DSP_USER_AGENT);
+    curl_easy_setopt(cp, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(cp, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(cp, CURLOPT_HEADERFUNCTION, dsp_accept_ranges_callback);
+    curl_easy_setopt(cp, CURLOPT_HEADERDATA, (void *)&accepts_ranges);
+
+    c_status = curl_easy_perform(cp);
+    if (c_status == CURLE_OK) {
+        curl_easy_getinfo(cp, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+        curl_easy_getinfo(cp, CURLINFO_EFFECTIVE_URL, &url);
+        if (url)
+            object_url = strdup(url);
+    }
+    curl_easy_cleanup(cp);
+
+    if (c_status != CURLE_OK) {
+        dsp_print_error(curl_easy_strerror(c_status));
+        return DSP_FALSE;
+    }
+    if (size <= 0) {
+        dsp_print_error("`--segmented' needs a server that reports the "
+                "size of the file");
+        return DSP_FALSE;
+    }
+    if (!accepts_ranges) {
+        dsp_print_error("`--segmented' needs a server that accepts byte "
+                "range requests");
+        return DSP_FALSE;
+    }
+
+    object_size = ((dsp_byte_t)size);
+    return DSP_TRUE;
+}
+
+/* split the file into one equally sized range per stream */
+static void dsp_assign_segments(void)
+{
+    unsigned int x;
+
+    if (((dsp_byte_t)stream_count) > object_size)
+        stream_count = ((unsigned int)object_size);
+
+    for (x = 0; x < stream_count; ++x) {
+        streams[x].range_pos = ((object_size / stream_count) * x);
+        if (x == (stream_count - 1))
+            streams[x].range_end = (object_size - 1);
+        else
+            streams[x].range_end =
+                (((object_size / stream_count) * (x + 1)) - 1);
+    }
+}
+
+/*
+ * A stream that finished its range takes over the second half of
+ * whatever is left of the biggest range still in progress, so one
+ * slow connection can't hold up the whole test. Returns DSP_TRUE if
+ * the stream was given more work and has been added back to `mp'.
+ */
+static dsp_boolean_t dsp_take_over_segment(CURLM *mp, struct dsp_stream *s)
+{
+    unsigned int x;
+    dsp_byte_t remaining;
+    dsp_byte_t most_remaining;
+    struct dsp_stream *v;
+    struct dsp_stream *slowest;
+
+    slowest = NULL;
+    most_remaining = DSP_ZERO_BYTES;
+
+    for (x = 0; x < stream_count; ++x) {
+        v = &streams[x];
+        if ((v == s) || v->end_time || v->range_done)
+            continue;
+        remaining = ((v->range_end + 1) - v->range_pos);
+        if (remaining > most_remaining) {
+            most_remaining = remaining;
+            slowest = v;
+        }
+    }
+
+    if (!slowest || (most_remaining < DSP_MIN_SEGMENT_SPLIT_SIZE))
+        return DSP_FALSE;
+
+    s->range_end = slowest->range_end;
+    slowest->range_end = (slowest->range_pos + (most_remaining / 2) - 1);
+    s->range_pos = (slowest->range_end + 1);
+
+    curl_multi_remove_handle(mp, s->cp);
+    if (dsp_set_stream_range(s) != CURLE_OK)
+        return DSP_FALSE;
+    curl_multi_add_handle(mp, s->cp);
+    return DSP_TRUE;
+}
+
+/*
+ * Make the list of --mirrors candidates out of `mirror_list', each one
+ * being where the default test file is found on that mirror.
+ */
+static void dsp_make_mirrors(void)
+{
+    size_t n;
+    size_t n_base;
+    char *list;
+    char *base;
+    const char *path;
+
+    path = dsp_get_url() + strlen(DSP_GNU_URL);
+    list = strdup(mirror_list);
+    if (!list) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    for (base = strtok(list, ","); base; base = strtok(NULL, ",")) {
+        if (!*base || (mirror_count == DSP_MAX_MIRRORS))
+            continue;
+        n_base = strlen(base);
+        n = (n_base + strlen(path) + 2);
+        mirrors[mirror_count].url = (char *)malloc(n);
+        if (!mirrors[mirror_count].url) {
+            dsp_print_error(strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        snprintf(mirrors[mirror_count].url, n, "%s%s%s", base,
+                (base[n_base - 1] == '/') ? "" : "/", path);
+        ++mirror_count;
+    }
+    free(list);
+
+    if (!mirror_count) {
+        dsp_print_error("`--mirrors' requires at least one URL");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* the responsive mirrors first, the closest of them first */
+static int dsp_compare_mirrors(const void *a, const void *b)
+{
+    const struct dsp_mirror *x;
+    const struct dsp_mirror *y;
+
+    x = (const struct dsp_mirror *)a;
+    y = (const struct dsp_mirror *)b;
+    if (x->responsive != y->responsive)
+        return (x->responsive) ? -1 : 1;
+    if (x->rtt < y->rtt)
+        return -1;
+    if (x->rtt > y->rtt)
+        return 1;
+    return 0;
+}
+
+/*
+ * Send a HEAD request for the test file to every --mirrors candidate
+ * at once. A mirror that has the file is ranked by how long its TCP
+ * connect took, which is one round trip; the `mirror_sources' best
+ * ones are used for the test.
+ */
+static void dsp_select_mirrors(void)
+{
+    size_t x;
+    int running;
+    int n_msgs;
+    double namelookup;
+    double connect;
+    CURLM *mp;
+    CURLMsg *msg;
+    struct dsp_mirror *m;
+
+    dsp_make_mirrors();
+    mp = curl_multi_init();
+    if (!mp) {
+        dsp_print_error(curl_easy_strerror(CURLE_FAILED_INIT));
+        exit(EXIT_FAILURE);
+    }
+
+    for (x = 0; x < mirror_count; ++x) {
+        m = &mirrors[x];
+        m->cp = curl_easy_init();
+        if (!m->cp) {
+            dsp_print_error(curl_easy_strerror(CURLE_FAILED_INIT));
+            exit(EXIT_FAILURE);
+        }
+        curl_easy_setopt(m->cp, CURLOPT_URL, m->url);
+        curl_easy_setopt(m->cp, CURLOPT_USERAGENT, DSP_USER_AGENT);
+        curl_easy_setopt(m->cp, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(m->cp, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(m->cp, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(m->cp, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(m->cp, CURLOPT_CONNECTTIMEOUT_MS,
+                DSP_PROBE_TIMEOUT_MS);
+        curl_easy_setopt(m->cp, CURLOPT_TIMEOUT_MS, DSP_MIRROR_TIMEOUT_MS);
+        curl_easy_setopt(m->cp, CURLOPT_PRIVATE, (void *)m);
+        curl_multi_add_handle(mp, m->cp);
+    }
+
+    running = 1;
+    while (running && !daemon_stopping) {
+        if (curl_multi_perform(mp, &running) != CURLM_OK)
+            break;
+        while ((msg = curl_multi_info_read(mp, &n_msgs))) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            m = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE,
+                    (char **)&m);
+            if (!m || (msg->data.result != CURLE_OK))
+                continue;
+            namelookup = 0.0;
+            connect = 0.0;
+            curl_easy_getinfo(m->cp, CURLINFO_NAMELOOKUP_TIME, &namelookup);
+            curl_easy_getinfo(m->cp, CURLINFO_CONNECT_TIME, &connect);
+            m->rtt = (connect > namelookup) ? (connect - namelookup) : 0.0;
+            m->responsive = DSP_TRUE;
+        }
+        if (running)
+#if LIBCURL_VERSION_NUM >= 0x074200
+            curl_multi_poll(mp, NULL, 0, 100, NULL);
+#else
+            curl_multi_wait(mp, NULL, 0, 100, NULL);
+#endif
+    }
+
+    for (x = 0; x < mirror_count; ++x) {
+        curl_multi_remove_handle(mp, mirrors[x].cp);
+        curl_easy_cleanup(mirrors[x].cp);
+        mirrors[x].cp = NULL;
+    }
+    curl_multi_cleanup(mp);
+
+    qsort(mirrors, mirror_count, sizeof(struct dsp_mirror),
+            dsp_compare_mirrors);
+    if (!mirrors[0].responsive) {
+        dsp_print_error("none of the %lu mirrors has the test file",
+                (unsigned long)mirror_count);
+        exit(EXIT_FAILURE);
+    }
+    for (x = 0; (x < mirror_sources) && mirrors[x].responsive; ++x)
+        mirrors[x].used = DSP_TRUE;
+    mirror_sources = (unsigned int)x;
+}
+
+/*
+ * Make the handle of `s' send an --upload with PUT (or POST with
+ * `--post'). Without a size libcurl sends it in chunks for as long
+ * as the read callback goes on. The `Expect:' header that libcurl
+ * would wait up to a second for an answer to is left out.
+ */
+static CURLcode dsp_setup_upload(struct dsp_stream *s)
+{
+    curl_off_t size;
+    CURLcode c_status;
+
+    size = (upload_size) ? ((curl_off_t)upload_size) : ((curl_off_t)-1);
+    if (use_post) {
+        c_status = curl_easy_setopt(s->cp, CURLOPT_POST, 1L);
+        if (c_status == CURLE_OK)
+            c_status = curl_easy_setopt(s->cp, CURLOPT_POSTFIELDSIZE_LARGE,
+                    size);
+    } else {
+        c_status = curl_easy_setopt(s->cp, CURLOPT_UPLOAD, 1L);
+        if (c_status == CURLE_OK)
+            c_status = curl_easy_setopt(s->cp, CURLOPT_INFILESIZE_LARGE,
+                    size);
+    }
+    if (c_status == CURLE_OK)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_READFUNCTION,
+                dsp_upload_read_callback);
+    if (c_status == CURLE_OK)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_READDATA, (void *)s);
+    if (c_status == CURLE_OK)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_HTTPHEADER,
+                upload_headers);
+    /* a refused upload shouldn't look like a fast one */
+    if (c_status == CURLE_OK)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_FAILONERROR, 1L);
+    return c_status;
+}
+
+#ifdef DSP_HAVE_SOCKET_OPTIONS
+/*
+ * Apply --rcvbuf, --nodelay and --congestion to a new connection
+ * before it connects, so that the receive buffer is already there
+ * when the window scale is agreed on. Systems are free to round or
+ * cap SO_RCVBUF, so what it came to is kept in `effective_rcvbuf'.
+ */
+static int dsp_sockopt_callback(void *data,
+                                curl_socket_t fd,
+                                curlsocktype purpose)
+{
+    int n;
+    socklen_t length;
+
+    if (purpose != CURLSOCKTYPE_IPCXN)
+        return CURL_SOCKOPT_OK;
+
+    if (tuning.rcvbuf) {
+        n = (int)tuning.rcvbuf;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n)) != 0) {
+            dsp_print_error("SO_RCVBUF: %s", strerror(errno));
+            return CURL_SOCKOPT_ERROR;
+        }
+        length = sizeof(n);
+        if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &n, &length) == 0)
+            effective_rcvbuf = (dsp_byte_t)n;
+    }
+    if (tuning.nodelay >= 0) {
+        n = tuning.nodelay;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &n, sizeof(n)) != 0) {
+            dsp_print_error("TCP_NODELAY: %s", strerror(errno));
+            return CURL_SOCKOPT_ERROR;
+        }
+    }
+# ifdef TCP_CONGESTION
+    if (tuning.congestion && (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION,
+                    tuning.congestion,
+                    (socklen_t)strlen(tuning.congestion)) != 0)) {
+        dsp_print_error("TCP_CONGESTION: %s", strerror(errno));
+        return CURL_SOCKOPT_ERROR;
+    }
+# endif
+    return CURL_SOCKOPT_OK;
+}
+#endif
+
+/* set a stream up for the current `tuning', a --sweep does this again
+   before every run */
+static CURLcode dsp_setup_tuning(struct dsp_stream *s)
+{
+    CURLcode c_status;
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_BUFFERSIZE,
+            (long)((tuning.buffer_size) ? tuning.buffer_size :
+                DSP_DEFAULT_BUFFER_SIZE));
+    if (c_status != CURLE_OK)
+        return c_status;
+    c_status = curl_easy_setopt(s->cp, CURLOPT_TCP_NODELAY,
+            (tuning.nodelay) ? 1L : 0L);
+    if (c_status != CURLE_OK)
+        return c_status;
+#ifdef DSP_HAVE_SOCKET_OPTIONS
+    c_status = curl_easy_setopt(s->cp, CURLOPT_SOCKOPTFUNCTION,
+            dsp_sockopt_callback);
+    if (c_status != CURLE_OK)
+        return c_status;
+#endif
+    /* the options only take hold on new connections */
+    if (sweep || fresh_connections)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_FORBID_REUSE, 1L);
+    return c_status;
+}
+
+static dsp_boolean_t dsp_is_https_url(const char *url)
+{
+    const char *scheme = "https://";
+
+    while (*scheme && (tolower((unsigned char)*url) == *scheme)) {
+        ++url;
+        ++scheme;
+    }
+    return (*scheme) ? DSP_FALSE : DSP_TRUE;
+}
+
+/* why `version' of HTTP can't be used for the test, or NULL if it can */
+static const char *dsp_check_http_version(dsp_http_t version)
+{
+    curl_version_info_data *info;
+
+    info = curl_version_info(CURLVERSION_NOW);
+    if (version == DSP_HTTP_2) {
+#if LIBCURL_VERSION_NUM >= 0x073100
+        if (info->features & CURL_VERSION_HTTP2)
+            return NULL;
+#endif
+        return "libcurl was built without HTTP/2";
+    }
+    if (version == DSP_HTTP_3) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+        if (!(info->features & CURL_VERSION_HTTP3))
+            return "libcurl was built without HTTP/3";
+        if (!dsp_is_https_url(dsp_get_url()))
+            return "HTTP/3 needs an https:// URL";
+        return NULL;
+#else
+        return "libcurl was built without HTTP/3";
+#endif
+    }
+    return NULL;
+}
+
+/*
+ * Set a stream up for --http and --multiplex, which --compare-http
+ * changes before every run. HTTP/2 is asked for with ALPN over TLS and
+ * with an Upgrade to h2c over http://, so that a server that doesn't
+ * speak it still answers over HTTP/1.1.
+ */
+static CURLcode dsp_setup_http(struct dsp_stream *s)
+{
+    long version;
+    CURLcode c_status;
+
+    version = CURL_HTTP_VERSION_NONE;
+    if (http_version == DSP_HTTP_1_1)
+        version = CURL_HTTP_VERSION_1_1;
+#if LIBCURL_VERSION_NUM >= 0x073100
+    else if (http_version == DSP_HTTP_2)
+        version = CURL_HTTP_VERSION_2_0;
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074200
+    else if (http_version == DSP_HTTP_3)
+        version = CURL_HTTP_VERSION_3;
+#endif
+    c_status = curl_easy_setopt(s->cp, CURLOPT_HTTP_VERSION, version);
+#if LIBCURL_VERSION_NUM >= 0x073100
+    /* wait for the one connection rather than opening more */
+    if (c_status == CURLE_OK)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_PIPEWAIT,
+                (multiplex) ? 1L : 0L);
+#endif
+    /* some versions of libcurl (7.88 among them) can stall streams
+       multiplexed on one connection that read into small buffers */
+    if ((c_status == CURLE_OK) && !tuning.buffer_size)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_BUFFERSIZE,
+                (long)((multiplex) ? DSP_MULTIPLEX_BUFFER_SIZE :
+                    DSP_DEFAULT_BUFFER_SIZE));
+    return c_status;
+}
+
+static dsp_boolean_t dsp_setup_curl(struct dsp_stream *s)
+{
+    int s_errno;
+    CURLcode c_status;
+
+    c_status = CURLE_OK;
+    s->cp = curl_easy_init();
+
+    if (!s->cp) {
+        c_status = CURLE_FAILED_INIT;
+        goto failure;
+    }
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_URL, dsp_get_url());
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_USERAGENT, DSP_USER_AGENT);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_FOLLOWLOCATION, 1L);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_PRIVATE, (void *)s);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+#ifdef DSP_HAVE_RANGE_FILE
+    if (keep_payload && segmented) {
+        /* all of the streams write into the first one's file */
+        if (!s->id && !dsp_open_range_file(s)) {
+            curl_easy_cleanup(s->cp);
+            s->cp = NULL;
+            return DSP_FALSE;
+        }
+        c_status = curl_easy_setopt(s->cp, CURLOPT_WRITEFUNCTION,
+                dsp_range_write_callback);
+    } else
+#endif
+    if (keep_payload) {
+        /* with --segmented all streams write into the first one's file */
+        if (segmented && (s->id > 0))
+            s->fp = fopen(streams[0].temp_file_path, "r+b");
+        else {
+            s->temp_file_path = dsp_make_temp_file_path(s->id);
+            if (!s->temp_file_path || !*s->temp_file_path) {
+                curl_easy_cleanup(s->cp);
+                s->cp = NULL;
+                return DSP_FALSE;
+            }
+            s->fp = fopen(s->temp_file_path, "w+b");
+        }
+        if (!s->fp) {
+            s_errno = errno;
+            dsp_print_error(strerror(s_errno));
+            curl_easy_cleanup(s->cp);
+            s->cp = NULL;
+            return DSP_FALSE;
+        }
+
+        c_status = curl_easy_setopt(s->cp, CURLOPT_WRITEFUNCTION,
+                dsp_file_write_callback);
+    } else if (s->sending)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_WRITEFUNCTION,
+                dsp_response_callback);
+#ifdef DSP_HAVE_SAVE
+    else if (save_path)
+        c_status = curl_easy_setopt(s->cp, CURLOPT_WRITEFUNCTION,
+                dsp_save_callback);
+#endif
+    else
+        c_status = curl_easy_setopt(s->cp, CURLOPT_WRITEFUNCTION,
+                dsp_discard_callback);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    if (s->sending) {
+        c_status = dsp_setup_upload(s);
+        if (c_status != CURLE_OK)
+            goto failure;
+    }
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_WRITEDATA, (void *)s);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_NOPROGRESS, 0L);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+    c_status =
+        curl_easy_setopt(s->cp, CURLOPT_XFERINFOFUNCTION,
+                dsp_progress_callback);
+#else
+    c_status =
+        curl_easy_setopt(s->cp, CURLOPT_PROGRESSFUNCTION,
+                dsp_progress_callback);
+#endif
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = curl_easy_setopt(s->cp, CURLOPT_PROGRESSDATA, (void *)s);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = dsp_setup_tuning(s);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    c_status = dsp_setup_http(s);
+    if (c_status != CURLE_OK)
+        goto failure;
+
+    /* with --fresh every test looks the name up, connects and shakes
+       hands in full again, dsp_setup_tuning() having stopped the
+       connections from being kept */
+    if (fresh_connections) {
+        c_status = curl_easy_setopt(s->cp, CURLOPT_DNS_CACHE_TIMEOUT, 0L);
+        if (c_status != CURLE_OK)
+            goto failure;
+        c_status = curl_easy_setopt(s->cp, CURLOPT_SSL_SESSIONID_CACHE, 0L);
+        if (c_status != CURLE_OK)
+            goto failure;
+    }
+
+    return DSP_TRUE;
+
+failure:
+    dsp_print_error(curl_easy_strerror(c_status));
+    if (s->fp) {
+        fclose(s->fp);
+        s->fp = NULL;
+    }
+    if (s->cp) {
+        curl_easy_cleanup(s->cp);
+        s->cp = NULL;
+    }
+    return DSP_FALSE;
+}
+
+/*
+ * The rate over the time the body of the file was arriving, that is
+ * from the first byte (`first_byte' after the start of the test) on,
+ * leaving out the name lookup, connecting and waiting for the server.
+ * Returns -1 if the time of the first byte isn't known.
+ */
+static double dsp_get_body_rate(dsp_byte_t bytes,
+                                dsp_nsec_t elapsed,
+                                dsp_nsec_t first_byte)
+{
+    if (!first_byte || (first_byte >= elapsed))
+        return -1.0;
+    return dsp_get_rate(bytes, elapsed - first_byte);
+}
+
+/* when the body started going over the connection of `s': the first
+   byte of a download, or the end of the request's set up for an upload */
+static dsp_nsec_t dsp_get_body_start(const struct dsp_stream *s)
+{
+    return dsp_sec_to_nsec((s->sending) ? s->timings.pretransfer :
+            s->timings.starttransfer);
+}
+
+/* when the body of any of the streams started, or 0 if unknown */
+static dsp_nsec_t dsp_get_first_byte_time(void)
+{
+    unsigned int x;
+    dsp_nsec_t t;
+    dsp_nsec_t first;
+
+    first = DSP_ZERO_NSEC;
+    for (x = 0; x < stream_count; ++x) {
+        t = dsp_get_body_start(&streams[x]);
+        if (t && (!first || (t < first)))
+            first = t;
+    }
+    return first;
+}
+
+static void dsp_fill_display_data(struct dsp_display_data *dd,
+                                  dsp_nsec_t elapsed,
+                                  dsp_nsec_t first_byte,
+                                  dsp_byte_t bytes,
+                                  dsp_byte_t most,
+                                  dsp_byte_t least)
+{
+    dd->total_down_size[0] = '\0';
+    dd->total_down_time[0] = '\0';
+    dd->average_down_rate[0] = '\0';
+    dd->body_down_rate[0] = '\0';
+    dd->peak_down_rate[0] = '\0';
+    dd->lowest_down_rate[0] = '\0';
+
+    dsp_format_size(dd->total_down_size, DSP_SIZE_BUFFER_SIZE, bytes);
+    dsp_format_time(dd->total_down_time, DSP_TIME_BUFFER_SIZE, elapsed);
+    dsp_format_rate(dd->average_down_rate, DSP_SPEED_BUFFER_SIZE,
+            dsp_get_rate(bytes, elapsed));
+    dsp_format_rate(dd->body_down_rate, DSP_SPEED_BUFFER_SIZE,
+            dsp_get_body_rate(bytes, elapsed, first_byte));
+    if (most)
+        dsp_format_rate(dd->peak_down_rate, DSP_SPEED_BUFFER_SIZE,
+                (double)most);
+    if (least)
+        dsp_format_rate(dd->lowest_down_rate, DSP_SPEED_BUFFER_SIZE,
+                (double)least);
+}
+
+/* the tags say `d/l', which is shown as `u/l' for the `sending' side */
+static void dsp_show_direction_line(const char *tag,
+                                    const char *value,
+                                    dsp_boolean_t sending)
+{
+    const char *d;
+
+    d = (sending) ? strstr(tag, "d/l") : NULL;
+    if (d)
+        printf("%.*su%s", (int)(d - tag), tag, d + 1);
+    else
+        fputs(tag, stdout);
+    if (*value)
+        puts(value);
+    else
+        puts(DSP_UNKNOWN_DISPLAY_DATA);
+}
+
+static void dsp_show_display_line(const char *tag, const char *value)
+{
+    dsp_show_direction_line(tag, value, upload);
+}
+
+static void dsp_show_display_data(const struct dsp_display_data *dd)
+{
+    dsp_show_display_line(DSP_TOTAL_DOWN_TIME_DISPLAY_TAG,
+            dd->total_down_time);
+    dsp_show_display_line(DSP_TOTAL_DOWN_SIZE_DISPLAY_TAG,
+            dd->total_down_size);
+    dsp_show_display_line(DSP_AVERAGE_DOWN_RATE_DISPLAY_TAG,
+            dd->average_down_rate);
+    dsp_show_display_line(DSP_BODY_DOWN_RATE_DISPLAY_TAG,
+            dd->body_down_rate);
+    dsp_show_display_line(DSP_PEAK_DOWN_RATE_DISPLAY_TAG,
+            dd->peak_down_rate);
+    dsp_show_display_line(DSP_LOWEST_DOWN_RATE_DISPLAY_TAG,
+            dd->lowest_down_rate);
+}
+
+/* a short span of time in milliseconds, or as usual from a second on */
+static void dsp_format_latency(char *buffer, size_t n, double secs)
+{
+    if (secs >= 1.0)
+        dsp_format_time(buffer, n, dsp_sec_to_nsec(secs));
+    else
+        snprintf(buffer, n, "%.2f ms", (secs > 0.0) ? (secs * 1000.0) : 0.0);
+}
+
+static void dsp_show_phase(const char *tag, double secs)
+{
+    char value[DSP_TIME_BUFFER_SIZE];
+
+    dsp_format_latency(value, DSP_TIME_BUFFER_SIZE, secs);
+    dsp_show_display_line(tag, value);
+}
+
+/* the --mirrors the test used, with the round trip they were picked by */
+static void dsp_show_mirrors(void)
+{
+    size_t x;
+    char rtt[DSP_TIME_BUFFER_SIZE];
+
+    for (x = 0; (x < mirror_count) && mirrors[x].used; ++x) {
+        dsp_format_latency(rtt, DSP_TIME_BUFFER_SIZE, mirrors[x].rtt);
+        printf(DSP_MIRROR_DISPLAY_TAG "%s (%s)\n", mirrors[x].url, rtt);
+    }
+}
+
+/*
+ * How long each phase of a stream's transfer took according to
+ * libcurl, which gives the time from the start of the transfer to the
+ * end of each phase. A connection that was reused (by a --daemon)
+ * has no name lookup or connect phase to speak of. TLS is only shown
+ * for the protocols that have it.
+ */
+static void dsp_show_phases(const struct dsp_timings *tm)
+{
+    double connected;
+    char value[DSP_TIME_BUFFER_SIZE * 2];
+    char ttfb[DSP_TIME_BUFFER_SIZE];
+
+    if (tm->total <= 0.0)
+        return;
+
+    connected = (tm->appconnect > tm->connect) ? tm->appconnect :
+        tm->connect;
+    dsp_show_phase(DSP_NAMELOOKUP_DISPLAY_TAG, tm->namelookup);
+    dsp_show_phase(DSP_CONNECT_DISPLAY_TAG, tm->connect - tm->namelookup);
+    if (tm->appconnect > 0.0)
+        dsp_show_phase(DSP_APPCONNECT_DISPLAY_TAG,
+                tm->appconnect - tm->connect);
+    dsp_show_phase(DSP_PRETRANSFER_DISPLAY_TAG, tm->pretransfer - connected);
+
+    dsp_format_latency(value, DSP_TIME_BUFFER_SIZE,
+            tm->starttransfer - tm->pretransfer);
+    dsp_format_latency(ttfb, DSP_TIME_BUFFER_SIZE, tm->starttransfer);
+    snprintf(value + strlen(value), sizeof(value) - strlen(value),
+            " (TTFB %s)", ttfb);
+    dsp_show_display_line(DSP_STARTTRANSFER_DISPLAY_TAG, value);
+
+    dsp_show_phase(DSP_BODY_TRANSFER_DISPLAY_TAG,
+            tm->total - tm->starttransfer);
+}
+
+/*
+ * How much --auto saved compared to downloading everything: the bytes
+ * that were not downloaded and the time they would have taken at the
+ * average rate. Returns DSP_FALSE if --auto did not stop the test.
+ */
+static dsp_boolean_t dsp_get_auto_saved(dsp_byte_t *bytes, dsp_nsec_t *t)
+{
+    unsigned int x;
+    dsp_byte_t expected;
+    double rate;
+
+    *bytes = DSP_ZERO_BYTES;
+    *t = DSP_ZERO_NSEC;
+
+    if (!stop_time ||
+            (test_duration && ((stop_time - start_time) >= test_duration)))
+        return DSP_FALSE;
+
+    expected = object_size;
+    if (!segmented) {
+        for (x = 0; x < stream_count; ++x)
+            expected += streams[x].d_total;
+    }
+
+    rate = dsp_get_rate(total_bytes, end_time - start_time);
+    if ((expected > total_bytes) && (rate > 0.0)) {
+        *bytes = (expected - total_bytes);
+        *t = (dsp_nsec_t)((((double)*bytes) / rate) *
+                ((double)DSP_NSEC_IN_SEC));
+    }
+    return DSP_TRUE;
+}
+
+static void dsp_show_auto_saved(void)
+{
+    dsp_nsec_t t;
+    dsp_byte_t bytes;
+    char value[DSP_SIZE_BUFFER_SIZE + DSP_TIME_BUFFER_SIZE];
+    char saved_time[DSP_TIME_BUFFER_SIZE];
+
+    if (!dsp_get_auto_saved(&bytes, &t)) {
+        dsp_show_display_line(DSP_AUTO_SAVED_DISPLAY_TAG, (stop_time) ?
+                "nothing (the rate did not settle within `--duration')" :
+                "nothing (the download finished before the rate settled)");
+        return;
+    }
+
+    value[0] = '\0';
+    if (bytes) {
+        dsp_format_size(value, DSP_SIZE_BUFFER_SIZE, bytes);
+        dsp_format_time(saved_time, DSP_TIME_BUFFER_SIZE, t);
+        snprintf(value + strlen(value), sizeof(value) - strlen(value),
+                " and %s", saved_time);
+    }
+    dsp_show_display_line(DSP_AUTO_SAVED_DISPLAY_TAG, value);
+}
+
+/* the steady-state rate of a series and the time it started at */
+static dsp_boolean_t dsp_get_steady_rate(const struct dsp_series *ds,
+                                         double *rate,
+                                         dsp_nsec_t *since)
+{
+    size_t x;
+    const struct dsp_sample *last;
+
+    if (!dsp_series_find_steady_start(ds, &x))
+        return DSP_FALSE;
+    last = &ds->samples[ds->count - 1];
+    *rate = dsp_get_rate(last->bytes - ds->samples[x].bytes,
+            last->t - ds->samples[x].t);
+    *since = ds->samples[x].t;
+    return DSP_TRUE;
+}
+
+static void dsp_show_steady_state(void)
+{
+    double rate;
+    dsp_nsec_t since;
+    char value[DSP_SPEED_BUFFER_SIZE + DSP_TIME_BUFFER_SIZE];
+    char after[DSP_TIME_BUFFER_SIZE];
+
+    value[0] = '\0';
+    if (dsp_get_steady_rate(&download_series, &rate, &since)) {
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, rate);
+        if (*value) {
+            dsp_format_time(after, DSP_TIME_BUFFER_SIZE, since);
+            snprintf(value + strlen(value),
+                    sizeof(value) - strlen(value), " (after %s)", after);
+        }
+    }
+    dsp_show_display_line(DSP_STEADY_DOWN_RATE_DISPLAY_TAG, value);
+}
+
+/*
+ * Show how the rates are spread over buckets that are each twice as
+ * big as the one before, starting from the lowest rate. Intervals
+ * where nothing was received at all get a bucket of their own.
+ */
+static void dsp_show_histogram(const double *rates, size_t n)
+{
+    size_t x;
+    size_t y;
+    size_t i;
+    size_t first;
+    size_t n_buckets;
+    size_t most;
+    size_t counts[sizeof(dsp_byte_t) * CHAR_BIT];
+    double low;
+    double high;
+    char low_rate[DSP_SPEED_BUFFER_SIZE];
+    char high_rate[DSP_SPEED_BUFFER_SIZE];
+
+    for (first = 0; (first < n) && (rates[first] < 1.0); ++first)
+        ;
+
+    memset(counts, 0, sizeof(counts));
+    n_buckets = 0;
+    if (first < n) {
+        low = floor(rates[first]);
+        for (x = first, i = 0, high = (low * 2.0); x < n; ++x) {
+            while ((rates[x] >= high) &&
+                    (i < ((sizeof(counts) / sizeof(counts[0])) - 1))) {
+                high *= 2.0;
+                ++i;
+            }
+            ++counts[i];
+        }
+        n_buckets = (i + 1);
+    }
+
+    most = first;
+    for (i = 0; i < n_buckets; ++i)
+        if (counts[i] > most)
+            most = counts[i];
+
+    puts(DSP_HISTOGRAM_DISPLAY_TAG);
+
+    if (first > 0) {
+        dsp_format_rate(low_rate, DSP_SPEED_BUFFER_SIZE, 0.0);
+        printf("  %12s   %12s |", low_rate, "");
+        for (y = 0; y < ((first * DSP_HISTOGRAM_BAR_WIDTH) / most); ++y)
+            putchar('#');
+        printf(" %lu (%.1f%%)\n", (unsigned long)first,
+                ((((double)first) * 100.0) / ((double)n)));
+    }
+
+    if (!n_buckets)
+        return;
+
+    low = floor(rates[first]);
+    for (i = 0; i < n_buckets; ++i, low *= 2.0) {
+        dsp_format_rate(low_rate, DSP_SPEED_BUFFER_SIZE, low);
+        dsp_format_rate(high_rate, DSP_SPEED_BUFFER_SIZE, low * 2.0);
+        printf("  %12s - %12s |", low_rate, high_rate);
+        for (y = 0; y < ((counts[i] * DSP_HISTOGRAM_BAR_WIDTH) / most); ++y)
+            putchar('#');
+        printf(" %lu (%.1f%%)\n", (unsigned long)counts[i],
+                ((((double)counts[i]) * 100.0) / ((double)n)));
+    }
+}
+
+/* mean, deviation and percentiles of the sampled interval rates */
+static void dsp_show_statistics(void)
+{
+    size_t x;
+    double mean;
+    double stddev;
+    double *rates;
+    char tag[DSP_SIZE_BUFFER_SIZE];
+    char value[DSP_SPEED_BUFFER_SIZE];
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    rates = dsp_stats_get_sorted_rates(&download_stats);
+    if (!rates)
+        return;
+
+    dsp_get_mean_and_stddev(rates, download_stats.count, &mean, &stddev);
+
+    dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, mean);
+    dsp_show_display_line(DSP_MEAN_DOWN_RATE_DISPLAY_TAG, value);
+    dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, stddev);
+    dsp_show_display_line(DSP_STDDEV_DISPLAY_TAG, value);
+    if (mean > 0.0)
+        snprintf(value, DSP_SPEED_BUFFER_SIZE, "%.1f%%",
+                ((stddev / mean) * 100.0));
+    else
+        value[0] = '\0';
+    dsp_show_display_line(DSP_VARIATION_DISPLAY_TAG, value);
+
+    for (x = 0; x < DSP_N_PERCENTILES; ++x) {
+        snprintf(tag, DSP_SIZE_BUFFER_SIZE, "%uth percentile:",
+                percentiles[x]);
+        printf("%-*s", (int)strlen(DSP_MEAN_DOWN_RATE_DISPLAY_TAG), tag);
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE,
+                dsp_get_percentile(rates, download_stats.count,
+                    (double)percentiles[x]));
+        dsp_show_display_line("", value);
+    }
+
+    if (show_histogram)
+        dsp_show_histogram(rates, download_stats.count);
+    free(rates);
+}
+
+/* the percentiles of the idle and loaded --latency probes side by side */
+static void dsp_show_latency(void)
+{
+    size_t x;
+    int width;
+    double added;
+    double *idle;
+    double *loaded;
+    char tag[DSP_SIZE_BUFFER_SIZE];
+    char a[DSP_TIME_BUFFER_SIZE];
+    char b[DSP_TIME_BUFFER_SIZE];
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    idle = dsp_probes_get_sorted_rtts(&idle_probes);
+    loaded = dsp_probes_get_sorted_rtts(&loaded_probes);
+    width = (int)strlen(DSP_MEAN_DOWN_RATE_DISPLAY_TAG);
+
+    printf("%-*s%12s %12s\n", width, DSP_LATENCY_DISPLAY_TAG, "idle",
+            "loaded");
+    for (x = 0; x < DSP_N_PERCENTILES; ++x) {
+        snprintf(tag, DSP_SIZE_BUFFER_SIZE, "%uth percentile:",
+                percentiles[x]);
+        strcpy(a, DSP_UNKNOWN_DISPLAY_DATA);
+        strcpy(b, DSP_UNKNOWN_DISPLAY_DATA);
+        if (idle)
+            dsp_format_latency(a, DSP_TIME_BUFFER_SIZE,
+                    dsp_get_percentile(idle, idle_probes.count,
+                        (double)percentiles[x]));
+        if (loaded)
+            dsp_format_latency(b, DSP_TIME_BUFFER_SIZE,
+                    dsp_get_percentile(loaded, loaded_probes.count,
+                        (double)percentiles[x]));
+        printf("%-*s%12s %12s\n", width, tag, a, b);
+    }
+    snprintf(a, DSP_TIME_BUFFER_SIZE, "%lu (%lu)", idle_probes.sent,
+            idle_probes.failed);
+    snprintf(b, DSP_TIME_BUFFER_SIZE, "%lu (%lu)", loaded_probes.sent,
+            loaded_probes.failed);
+    printf("%-*s%12s %12s\n", width, DSP_PROBES_DISPLAY_TAG, a, b);
+
+    /* how much the download added to the median round trip */
+    a[0] = '\0';
+    if (idle && loaded) {
+        added = (dsp_get_percentile(loaded, loaded_probes.count, 50.0) -
+                dsp_get_percentile(idle, idle_probes.count, 50.0));
+        dsp_format_latency(b, DSP_TIME_BUFFER_SIZE, fabs(added));
+        snprintf(a, DSP_TIME_BUFFER_SIZE, "%c%s (median)",
+                (added < 0.0) ? '-' : '+', b);
+    }
+    dsp_show_display_line(DSP_ADDED_LATENCY_DISPLAY_TAG, a);
+
+    free(idle);
+    free(loaded);
+}
+
+/* the --hash of the test, and whether it was checked against --expect */
+static void dsp_show_digest(void)
+{
+    unsigned int complete;
+    const unsigned char *digest;
+    char hex[DSP_DIGEST_BUFFER_SIZE];
+    char value[DSP_DIGEST_BUFFER_SIZE + DSP_RANGE_BUFFER_SIZE];
+
+    value[0] = '\0';
+    digest = dsp_get_test_digest(&complete);
+    if (digest) {
+        dsp_format_digest(hex, digest);
+        if (complete < stream_count)
+            snprintf(value, sizeof(value), "%s (%u of %u streams)", hex,
+                    complete, stream_count);
+        else
+            strcpy(value, hex);
+    } else if (complete)
+        strcpy(value, "(differs between the streams)");
+    dsp_show_display_line((hash_algorithm == DSP_HASH_SHA256) ?
+            DSP_SHA256_DISPLAY_TAG : DSP_CRC32C_DISPLAY_TAG, value);
+    if (expected_digest_size)
+        dsp_show_display_line(DSP_INTEGRITY_DISPLAY_TAG,
+                "matches `--expect'");
+}
+
+/* the rate the --save file was written at while the writer was busy */
+static double dsp_get_storage_rate(void)
+{
+    return dsp_get_rate(save_file.bytes, save_file.write_time);
+}
+
+/* the rate from the start of the test until all of it was on disk */
+static double dsp_get_end_to_end_rate(void)
+{
+    return dsp_get_rate(total_bytes,
+            (end_time - start_time) + save_file.drain_time);
+}
+
+/* it was the disk if the download had to wait for it long enough */
+static const char *dsp_get_bottleneck(void)
+{
+    return (((double)save_file.stall_time) >
+            (DSP_SAVE_STALL_LIMIT * ((double)(end_time - start_time)))) ?
+        "storage" : "network";
+}
+
+/* where --save put the file, and how fast the disk was compared with
+   the network (the d/l rates above) */
+static void dsp_show_save(void)
+{
+    char value[DSP_SPEED_BUFFER_SIZE + DSP_TIME_BUFFER_SIZE];
+    char t[DSP_TIME_BUFFER_SIZE];
+
+    printf(DSP_SAVED_TO_DISPLAY_TAG "%s (%s%s)\n", save_path,
+            (save_file.direct) ? "O_DIRECT" : "page cache",
+            (save_file.preallocated) ? ", preallocated" : "");
+    value[0] = '\0';
+    dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, dsp_get_storage_rate());
+    dsp_show_display_line(DSP_STORAGE_RATE_DISPLAY_TAG, value);
+    value[0] = '\0';
+    dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, dsp_get_end_to_end_rate());
+    dsp_show_display_line(DSP_END_TO_END_RATE_DISPLAY_TAG, value);
+    dsp_format_latency(t, DSP_TIME_BUFFER_SIZE,
+            dsp_nsec_to_sec(save_file.stall_time));
+    snprintf(value, sizeof(value), "%s (%.1f%% of the test)", t,
+            (end_time > start_time) ? ((100.0 * save_file.stall_time) /
+                (end_time - start_time)) : 0.0);
+    dsp_show_display_line(DSP_DISK_WAIT_DISPLAY_TAG, value);
+    dsp_show_display_line(DSP_BOTTLENECK_DISPLAY_TAG, dsp_get_bottleneck());
+}
+
+static void dsp_write_json_string(const char *str)
+{
+    putchar('"');
+    for (; *str; ++str) {
+        if ((*str == '"') || (*str == '\\'))
+            printf("\\%c", *str);
+        else if (((unsigned char)*str) < 0x20)
+            printf("\\u%04x", (unsigned int)(unsigned char)*str);
+        else
+            putchar(*str);
+    }
+    putchar('"');
+}
+
+/* a rate that isn't known (a negative one) is written as null */
+static void dsp_write_json_rate(const char *name, double rate)
+{
+    printf(",\"%s\":", name);
+    if (rate < 0.0)
+        fputs("null", stdout);
+    else
+        printf("%.3f", rate);
+}
+
+static void dsp_write_json_timings(const struct dsp_timings *tm)
+{
+    printf("{\"namelookup_ns\":%llu,\"connect_ns\":%llu,"
+            "\"appconnect_ns\":%llu,\"pretransfer_ns\":%llu,"
+            "\"starttransfer_ns\":%llu,\"total_ns\":%llu}",
+            dsp_sec_to_nsec(tm->namelookup), dsp_sec_to_nsec(tm->connect),
+            dsp_sec_to_nsec(tm->appconnect), dsp_sec_to_nsec(tm->pretransfer),
+            dsp_sec_to_nsec(tm->starttransfer), dsp_sec_to_nsec(tm->total));
+}
+
+static void dsp_write_json_probes(const char *name,
+                                  const struct dsp_probes *p)
+{
+    size_t x;
+    double *rtts;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    printf("\"%s\":{\"probes\":%lu,\"failed\":%lu,\"percentiles_ns\":",
+            name, p->sent, p->failed);
+    rtts = dsp_probes_get_sorted_rtts(p);
+    if (!rtts) {
+        fputs("null}", stdout);
+        return;
+    }
+    for (x = 0; x < DSP_N_PERCENTILES; ++x)
+        printf("%s\"p%u\":%llu", (x) ? "," : "{", percentiles[x],
+                dsp_sec_to_nsec(dsp_get_percentile(rtts, p->count,
+                        (double)percentiles[x])));
+    fputs("}}", stdout);
+    free(rtts);
+}
+
+/* a digest that isn't known is written as null */
+static void dsp_write_json_digest(const char *name,
+                                  const unsigned char *digest)
+{
+    char hex[DSP_DIGEST_BUFFER_SIZE];
+
+    printf(",\"%s\":", name);
+    if (digest) {
+        dsp_format_digest(hex, digest);
+        printf("\"%s\"", hex);
+    } else
+        fputs("null", stdout);
+}
+
+static void dsp_write_json_hash(void)
+{
+    unsigned int complete;
+    const unsigned char *digest;
+
+    digest = dsp_get_test_digest(&complete);
+    printf(",\"hash\":{\"algorithm\":\"%s\",\"implementation\":\"%s\"",
+            dsp_get_hash_name(), hash_implementation);
+    dsp_write_json_digest("digest", digest);
+    dsp_write_json_digest("expected",
+            (expected_digest_size) ? expected_digest : NULL);
+    printf(",\"complete_streams\":%u}", complete);
+}
+
+/* the results as one JSON object, in bytes, bytes/s and nanoseconds,
+   with the number and start (in seconds since the epoch) of the test
+   in front when running as a --daemon */
+static void dsp_show_results_json(void)
+{
+    size_t x;
+    dsp_nsec_t t;
+    dsp_byte_t bytes;
+    double rate;
+    double mean;
+    double stddev;
+    double *rates;
+    struct dsp_stream *s;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    putchar('{');
+    if (daemon_interval)
+        printf("\"run\":%lu,\"started\":%ld,", history.runs,
+                (long)test_started);
+    fputs("\"url\":", stdout);
+    dsp_write_json_string(dsp_get_url());
+    printf(",\"direction\":\"%s\"", (upload) ? "upload" : "download");
+    if (mirror_count) {
+        fputs(",\"mirrors\":[", stdout);
+        for (x = 0; x < mirror_count; ++x) {
+            fputs((x) ? ",{\"url\":" : "{\"url\":", stdout);
+            dsp_write_json_string(mirrors[x].url);
+            if (mirrors[x].responsive)
+                printf(",\"connect_ns\":%llu",
+                        dsp_sec_to_nsec(mirrors[x].rtt));
+            else
+                fputs(",\"connect_ns\":null", stdout);
+            printf(",\"used\":%s}", (mirrors[x].used) ? "true" : "false");
+        }
+        putchar(']');
+    }
+    printf(",\"streams\":%u,\"segmented\":%s,\"bytes\":%llu,"
+            "\"elapsed_ns\":%llu", stream_count,
+            (segmented) ? "true" : "false", total_bytes,
+            end_time - start_time);
+    dsp_write_json_rate("average_bytes_per_sec",
+            dsp_get_rate(total_bytes, end_time - start_time));
+    dsp_write_json_rate("body_bytes_per_sec",
+            dsp_get_body_rate(total_bytes, end_time - start_time,
+                dsp_get_first_byte_time()));
+    dsp_write_json_rate("peak_bytes_per_sec",
+            (most_bytes_per_sec) ? ((double)most_bytes_per_sec) : -1.0);
+    dsp_write_json_rate("lowest_bytes_per_sec",
+            (least_bytes_per_sec) ? ((double)least_bytes_per_sec) : -1.0);
+
+    if (dsp_get_steady_rate(&download_series, &rate, &t)) {
+        dsp_write_json_rate("steady_bytes_per_sec", rate);
+        printf(",\"steady_since_ns\":%llu", t);
+    } else
+        fputs(",\"steady_bytes_per_sec\":null,\"steady_since_ns\":null",
+                stdout);
+
+    if (auto_percent > 0.0) {
+        if (dsp_get_auto_saved(&bytes, &t))
+            printf(",\"auto_saved_bytes\":%llu,\"auto_saved_ns\":%llu",
+                    bytes, t);
+        else
+            fputs(",\"auto_saved_bytes\":null,\"auto_saved_ns\":null",
+                    stdout);
+    }
+
+    rates = dsp_stats_get_sorted_rates(&download_stats);
+    if (rates) {
+        dsp_get_mean_and_stddev(rates, download_stats.count, &mean, &stddev);
+        dsp_write_json_rate("mean_bytes_per_sec", mean);
+        dsp_write_json_rate("stddev_bytes_per_sec", stddev);
+        fputs(",\"percentiles_bytes_per_sec\":{", stdout);
+        for (x = 0; x < DSP_N_PERCENTILES; ++x)
+            printf("%s\"p%u\":%.3f", (x) ? "," : "", percentiles[x],
+                    dsp_get_percentile(rates, download_stats.count,
+                        (double)percentiles[x]));
+        putchar('}');
+        free(rates);
+    }
+
+    fputs(",\"timings\":", stdout);
+    dsp_write_json_timings(&streams[0].timings);
+
+    if (latency_interval) {
+        fputs(",\"latency\":{", stdout);
+        dsp_write_json_probes("idle", &idle_probes);
+        putchar(',');
+        dsp_write_json_probes("loaded", &loaded_probes);
+        putchar('}');
+    }
+
+    if (hash_algorithm)
+        dsp_write_json_hash();
+
+    if (save_path) {
+        fputs(",\"save\":{\"path\":", stdout);
+        dsp_write_json_string(save_path);
+        printf(",\"direct\":%s,\"preallocated\":%s,\"bytes\":%llu,"
+                "\"write_ns\":%llu,\"stall_ns\":%llu,\"drain_ns\":%llu",
+                (save_file.direct) ? "true" : "false",
+                (save_file.preallocated) ? "true" : "false", save_file.bytes,
+                save_file.write_time, save_file.stall_time,
+                save_file.drain_time);
+        dsp_write_json_rate("storage_bytes_per_sec", dsp_get_storage_rate());
+        dsp_write_json_rate("end_to_end_bytes_per_sec",
+                dsp_get_end_to_end_rate());
+        printf(",\"bottleneck\":\"%s\"}", dsp_get_bottleneck());
+    }
+
+    fputs(",\"client\":{\"cpu_ns\":", stdout);
+    if (client_cost.cpu_time)
+        printf("%llu", client_cost.cpu_time);
+    else
+        fputs("null", stdout);
+    printf(",\"data_callbacks\":%lu,\"progress_callbacks\":%lu,"
+            "\"iterations\":%lu,\"housekeeping_ns\":%llu}",
+            client_cost.data_callbacks, client_cost.progress_callbacks,
+            client_cost.iterations, client_cost.housekeeping_time);
+
+    fputs(",\"per_stream\":[", stdout);
+    for (x = 0; x < stream_count; ++x) {
+        s = &streams[x];
+        printf("%s{\"id\":%u,\"bytes\":%llu,\"elapsed_ns\":%llu",
+                (x) ? "," : "", s->id + 1, s->total_bytes,
+                s->end_time - start_time);
+        dsp_write_json_rate("average_bytes_per_sec",
+                dsp_get_rate(s->total_bytes, s->end_time - start_time));
+        dsp_write_json_rate("body_bytes_per_sec",
+                dsp_get_body_rate(s->total_bytes, s->end_time - start_time,
+                    dsp_get_body_start(s)));
+        dsp_write_json_rate("peak_bytes_per_sec", (s->most_bytes_per_sec) ?
+                ((double)s->most_bytes_per_sec) : -1.0);
+        dsp_write_json_rate("lowest_bytes_per_sec", (s->least_bytes_per_sec) ?
+                ((double)s->least_bytes_per_sec) : -1.0);
+        fputs(",\"timings\":", stdout);
+        dsp_write_json_timings(&s->timings);
+        if (hash_algorithm)
+            dsp_write_json_digest("digest", (s->hashed) ? s->digest : NULL);
+        putchar('}');
+    }
+
+    printf("],\"sample_interval_ns\":%llu,\"samples\":[", sample_interval);
+    for (x = 0; x < download_series.count; ++x)
+        printf("%s[%llu,%llu]", (x) ? "," : "", download_series.samples[x].t,
+                download_series.samples[x].bytes);
+    puts("]}");
+}
+
+/* a field in quotes, those in it doubled, as URLs may have both */
+static void dsp_write_csv_string(const char *str)
+{
+    putchar('"');
+    for (; *str; ++str) {
+        if (*str == '"')
+            putchar('"');
+        putchar(*str);
+    }
+    putchar('"');
+}
+
+static void dsp_write_csv_probes_header(const char *name)
+{
+    size_t x;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    printf(",%s_probes,%s_failed", name, name);
+    for (x = 0; x < DSP_N_PERCENTILES; ++x)
+        printf(",%s_p%u_ns", name, percentiles[x]);
+}
+
+static void dsp_write_csv_probes(const struct dsp_probes *p)
+{
+    size_t x;
+    double *rtts;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    printf(",%lu,%lu", p->sent, p->failed);
+    rtts = dsp_probes_get_sorted_rtts(p);
+    for (x = 0; x < DSP_N_PERCENTILES; ++x) {
+        putchar(',');
+        if (rtts)
+            printf("%llu", dsp_sec_to_nsec(dsp_get_percentile(rtts, p->count,
+                            (double)percentiles[x])));
+    }
+    free(rtts);
+}
+
+/*
+ * The results as a CSV header and row, followed by an empty line and
+ * the sample series with a header of its own. Rates that aren't known
+ * are left empty. A --daemon writes the header only once and then a
+ * row for every test, starting with its number and start time, and
+ * leaves out the samples.
+ */
+static void dsp_show_results_csv(void)
+{
+    size_t x;
+    dsp_nsec_t t;
+    double rate;
+    double mean;
+    double stddev;
+    double *rates;
+    unsigned int complete;
+    const unsigned char *digest;
+    const struct dsp_timings *tm;
+    char hex[DSP_DIGEST_BUFFER_SIZE];
+    static dsp_boolean_t header_shown = DSP_FALSE;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    if (!header_shown) {
+        if (daemon_interval)
+            fputs("run,started,", stdout);
+        fputs("url,direction,streams,segmented,bytes,elapsed_ns,"
+                "average_bytes_per_sec,body_bytes_per_sec,peak_bytes_per_sec,"
+                "lowest_bytes_per_sec,steady_bytes_per_sec,steady_since_ns,"
+                "mean_bytes_per_sec,stddev_bytes_per_sec", stdout);
+        for (x = 0; x < DSP_N_PERCENTILES; ++x)
+            printf(",p%u_bytes_per_sec", percentiles[x]);
+        fputs(",namelookup_ns,connect_ns,appconnect_ns,pretransfer_ns,"
+                "starttransfer_ns,total_ns", stdout);
+        if (latency_interval) {
+            dsp_write_csv_probes_header("idle");
+            dsp_write_csv_probes_header("loaded");
+        }
+        if (hash_algorithm)
+            fputs(",hash_algorithm,hash_digest,hash_complete_streams",
+                    stdout);
+        if (save_path)
+            fputs(",save_bytes,save_write_ns,save_stall_ns,save_drain_ns,"
+                    "storage_bytes_per_sec,end_to_end_bytes_per_sec,"
+                    "bottleneck", stdout);
+        putchar('\n');
+        header_shown = DSP_TRUE;
+    }
+
+    if (daemon_interval)
+        printf("%lu,%ld,", history.runs, (long)test_started);
+    dsp_write_csv_string(dsp_get_url());
+    printf(",%s,%u,%d,%llu,%llu,", (upload) ? "upload" : "download",
+            stream_count, (segmented) ? 1 : 0, total_bytes,
+            end_time - start_time);
+    rate = dsp_get_rate(total_bytes, end_time - start_time);
+    if (rate >= 0.0)
+        printf("%.3f", rate);
+    putchar(',');
+    rate = dsp_get_body_rate(total_bytes, end_time - start_time,
+            dsp_get_first_byte_time());
+    if (rate >= 0.0)
+        printf("%.3f", rate);
+    putchar(',');
+    if (most_bytes_per_sec)
+        printf("%llu", most_bytes_per_sec);
+    putchar(',');
+    if (least_bytes_per_sec)
+        printf("%llu", least_bytes_per_sec);
+    putchar(',');
+    if (dsp_get_steady_rate(&download_series, &rate, &t))
+        printf("%.3f,%llu", rate, t);
+    else
+        putchar(',');
+
+    rates = dsp_stats_get_sorted_rates(&download_stats);
+    if (rates) {
+        dsp_get_mean_and_stddev(rates, download_stats.count, &mean, &stddev);
+        printf(",%.3f,%.3f", mean, stddev);
+        for (x = 0; x < DSP_N_PERCENTILES; ++x)
+            printf(",%.3f", dsp_get_percentile(rates, download_stats.count,
+                        (double)percentiles[x]));
+        free(rates);
+    } else {
+        fputs(",,", stdout);
+        for (x = 0; x < DSP_N_PERCENTILES; ++x)
+            putchar(',');
+    }
+
+    tm = &streams[0].timings;
+    printf(",%llu,%llu,%llu,%llu,%llu,%llu",
+            dsp_sec_to_nsec(tm->namelookup), dsp_sec_to_nsec(tm->connect),
+            dsp_sec_to_nsec(tm->appconnect), dsp_sec_to_nsec(tm->pretransfer),
+            dsp_sec_to_nsec(tm->starttransfer), dsp_sec_to_nsec(tm->total));
+    if (latency_interval) {
+        dsp_write_csv_probes(&idle_probes);
+        dsp_write_csv_probes(&loaded_probes);
+    }
+    if (hash_algorithm) {
+        digest = dsp_get_test_digest(&complete);
+        printf(",%s,", dsp_get_hash_name());
+        if (digest) {
+            dsp_format_digest(hex, digest);
+            fputs(hex, stdout);
+        }
+        printf(",%u", complete);
+    }
+    if (save_path) {
+        printf(",%llu,%llu,%llu,%llu,", save_file.bytes, save_file.write_time,
+                save_file.stall_time, save_file.drain_time);
+        rate = dsp_get_storage_rate();
+        if (rate >= 0.0)
+            printf("%.3f", rate);
+        putchar(',');
+        rate = dsp_get_end_to_end_rate();
+        if (rate >= 0.0)
+            printf("%.3f", rate);
+        printf(",%s", dsp_get_bottleneck());
+    }
+    putchar('\n');
+
+    if (daemon_interval)
+        return;
+    puts("\nt_ns,bytes");
+    for (x = 0; x < download_series.count; ++x)
+        printf("%llu,%llu\n", download_series.samples[x].t,
+                download_series.samples[x].bytes);
+}
+
+static void dsp_show_results(void)
+{
+    unsigned int x;
+    struct dsp_stream *s;
+
+    if (output_format != DSP_FORMAT_TEXT) {
+        if (output_format == DSP_FORMAT_JSON)
+            dsp_show_results_json();
+        else
+            dsp_show_results_csv();
+        return;
+    }
+
+    if (mirror_count)
+        dsp_show_mirrors();
+    dsp_fill_display_data(&display_data, end_time - start_time,
+            dsp_get_first_byte_time(), total_bytes, most_bytes_per_sec,
+            least_bytes_per_sec);
+    dsp_show_display_data(&display_data);
+    /* with more streams each one's phases are shown with it below */
+    if (stream_count == 1)
+        dsp_show_phases(&streams[0].timings);
+    dsp_show_steady_state();
+    if (auto_percent > 0.0)
+        dsp_show_auto_saved();
+    dsp_show_statistics();
+    if (latency_interval)
+        dsp_show_latency();
+    if (hash_algorithm)
+        dsp_show_digest();
+    if (save_path)
+        dsp_show_save();
+
+    if (stream_count < 2)
+        return;
+
+    for (x = 0; x < stream_count; ++x) {
+        s = &streams[x];
+        printf("\n" DSP_STREAM_DISPLAY_TAG "%u of %u\n", s->id + 1,
+                stream_count);
+        dsp_fill_display_data(&display_data, s->end_time - start_time,
+                dsp_get_body_start(s), s->total_bytes,
+                s->most_bytes_per_sec, s->least_bytes_per_sec);
+        dsp_show_display_data(&display_data);
+        dsp_show_phases(&s->timings);
+    }
+}
+
+/*
+ * Write out as much of the --live buffer as can be written without
+ * waiting, unless `block' is given. A chunk of at most PIPE_BUF bytes
+ * never blocks once poll() says the pipe can be written to.
+ */
+static void dsp_flush_live_buffer(dsp_boolean_t block)
+{
+#ifdef HAVE_UNISTD_H
+    size_t n;
+    ssize_t written;
+# ifdef HAVE_POLL_H
+    struct pollfd pfd;
+# endif
+
+    while (live_buffer.length) {
+# ifdef HAVE_POLL_H
+        if (!block) {
+            pfd.fd = STDOUT_FILENO;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if ((poll(&pfd, 1, 0) != 1) || !(pfd.revents & POLLOUT))
+                return;
+        }
+# endif
+        n = live_buffer.length;
+# ifdef PIPE_BUF
+        if (n > PIPE_BUF)
+            n = PIPE_BUF;
+# endif
+        written = write(STDOUT_FILENO, live_buffer.data, n);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) && !block)
+                return;
+            live_buffer.length = 0;
+            return;
+        }
+        memmove(live_buffer.data, live_buffer.data + written,
+                live_buffer.length - ((size_t)written));
+        live_buffer.length -= ((size_t)written);
+    }
+#else
+    fwrite(live_buffer.data, 1, live_buffer.length, stdout);
+    fflush(stdout);
+    live_buffer.length = 0;
+#endif
+}
+
+/* queue one --live line for the interval that just ended */
+static void dsp_show_live_sample(dsp_nsec_t now_time)
+{
+    int n;
+    double eta;
+    dsp_nsec_t t;
+    char line[DSP_LIVE_LINE_SIZE];
+
+    t = (now_time - start_time);
+    eta = dsp_get_eta(now_time);
+    n = snprintf(line, DSP_LIVE_LINE_SIZE,
+            "{\"t_ns\":%llu,\"bytes\":%llu,\"rate_bytes_per_sec\":%.3f,",
+            t, total_bytes, (t > live_buffer.last_t) ?
+            dsp_get_rate(total_bytes - live_buffer.last_bytes,
+                t - live_buffer.last_t) : 0.0);
+    if (eta < 0.0)
+        n += snprintf(line + n, DSP_LIVE_LINE_SIZE - n, "\"eta_ns\":null");
+    else
+        n += snprintf(line + n, DSP_LIVE_LINE_SIZE - n, "\"eta_ns\":%llu",
+                dsp_sec_to_nsec(eta));
+    if (live_buffer.dropped)
+        n += snprintf(line + n, DSP_LIVE_LINE_SIZE - n, ",\"dropped\":%lu",
+                live_buffer.dropped);
+    n += snprintf(line + n, DSP_LIVE_LINE_SIZE - n, "}\n");
+
+    live_buffer.last_t = t;
+    live_buffer.last_bytes = total_bytes;
+
+    if ((live_buffer.length + ((size_t)n)) > DSP_LIVE_BUFFER_SIZE)
+        ++live_buffer.dropped;
+    else {
+        memcpy(live_buffer.data + live_buffer.length, line, (size_t)n);
+        live_buffer.length += ((size_t)n);
+        live_buffer.dropped = 0;
+    }
+    dsp_flush_live_buffer(DSP_FALSE);
+}
+
+static void dsp_get_timings(CURL *cp, struct dsp_timings *tm)
+{
+    curl_easy_getinfo(cp, CURLINFO_NAMELOOKUP_TIME, &tm->namelookup);
+    curl_easy_getinfo(cp, CURLINFO_CONNECT_TIME, &tm->connect);
+    curl_easy_getinfo(cp, CURLINFO_APPCONNECT_TIME, &tm->appconnect);
+    curl_easy_getinfo(cp, CURLINFO_PRETRANSFER_TIME, &tm->pretransfer);
+    curl_easy_getinfo(cp, CURLINFO_STARTTRANSFER_TIME, &tm->starttransfer);
+    curl_easy_getinfo(cp, CURLINFO_TOTAL_TIME, &tm->total);
+}
+
+/*
+ * Drive every stream through the multi handle until all of them
+ * are finished. Returns the first error any of the streams ran
+ * into or CURLE_OK if all of them succeeded.
+ */
+static CURLcode dsp_run_streams(CURLM *mp)
+{
+    int running;
+    int n_msgs;
+    int timeout;
+    dsp_nsec_t now_time;
+    dsp_nsec_t next_sample_time;
+    CURLMsg *msg;
+    CURLMcode m_status;
+    CURLcode c_status;
+    struct dsp_stream *s;
+
+    c_status = CURLE_OK;
+    running = 1;
+    next_sample_time = (start_time + sample_interval);
+    dsp_record_samples(start_time);
+
+    while (running) {
+        m_status = curl_multi_perform(mp, &running);
+        if (m_status != CURLM_OK) {
+            dsp_print_error(curl_multi_strerror(m_status));
+            return CURLE_FAILED_INIT;
+        }
+
+        now_time = dsp_get_time();
+        while ((msg = curl_multi_info_read(mp, &n_msgs))) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            s = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&s);
+            if (!s)
+                continue;
+            s->status = msg->data.result;
+            if (!s->timings.total)
+                dsp_get_timings(s->cp, &s->timings);
+            if (hash_algorithm && (s->status == CURLE_OK) && !s->sending) {
+                dsp_hash_final(&s->hash, s->digest);
+                s->hashed = DSP_TRUE;
+            }
+            /* refused data past the end of its range */
+            if (segmented && s->range_done &&
+                    (s->status == CURLE_WRITE_ERROR))
+                s->status = CURLE_OK;
+            if (stop_time && (s->status == CURLE_ABORTED_BY_CALLBACK))
+                s->status = CURLE_OK;
+            if (segmented && !stop_time && (s->status == CURLE_OK) &&
+                    dsp_take_over_segment(mp, s)) {
+                running = 1;
+                continue;
+            }
+            s->end_time = (stop_time) ? stop_time : now_time;
+            dsp_series_add(&s->series, s->end_time - start_time,
+                    s->total_bytes);
+            if ((s->status != CURLE_OK) && (c_status == CURLE_OK))
+                c_status = s->status;
+        }
+
+        if (now_time >= next_sample_time) {
+            dsp_record_samples(now_time);
+            if (live_output)
+                dsp_show_live_sample(now_time);
+            while (next_sample_time <= now_time)
+                next_sample_time += sample_interval;
+        }
+        if ((output_format == DSP_FORMAT_TEXT) && !live_output)
+            dsp_show_progress(now_time);
+        ++client_cost.iterations;
+        client_cost.housekeeping_time += (dsp_get_time() - now_time);
+
+        if (!running)
+            break;
+
+        /* wake up in time for the next sample */
+        timeout = (int)(((next_sample_time - now_time) + DSP_NSEC_IN_MSEC - 1) /
+                DSP_NSEC_IN_MSEC);
+#if LIBCURL_VERSION_NUM >= 0x074200
+        m_status = curl_multi_poll(mp, NULL, 0, timeout, NULL);
+#else
+        m_status = curl_multi_wait(mp, NULL, 0, timeout, NULL);
+#endif
+        if (m_status != CURLM_OK) {
+            dsp_print_error(curl_multi_strerror(m_status));
+            return CURLE_FAILED_INIT;
+        }
+    }
+    return c_status;
+}
+
+/* sleep until the monotonic clock reaches `t' or the daemon is stopped */
+static void dsp_sleep_until(dsp_nsec_t t)
+{
+    dsp_nsec_t now_time;
+#ifndef _WIN32
+    struct timespec ts;
+#endif
+
+    while (!daemon_stopping && ((now_time = dsp_get_time()) < t)) {
+#ifdef _WIN32
+        Sleep((DWORD)(((t - now_time) / DSP_NSEC_IN_MSEC) + 1));
+#else
+        ts.tv_sec = (time_t)((t - now_time) / DSP_NSEC_IN_SEC);
+        ts.tv_nsec = (long)((t - now_time) % DSP_NSEC_IN_SEC);
+        nanosleep(&ts, NULL);
+#endif
+    }
+}
+
+#ifdef DSP_HAVE_THREADS
+/*
+ * Start a thread with SIGINT and SIGTERM blocked, which leaves them to
+ * the main thread: that is the one that has to wake up to stop a
+ * --daemon (or --serve).
+ */
+static dsp_boolean_t dsp_create_thread(pthread_t *thread,
+                                       void *(*func)(void *),
+                                       void *arg)
+{
+    int rc;
+    sigset_t set;
+    sigset_t old_set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    rc = pthread_create(thread, NULL, func, arg);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (rc != 0) {
+        dsp_print_error(strerror(rc));
+        return DSP_FALSE;
+    }
+    return DSP_TRUE;
+}
+
+/*
+ * Make one --latency probe: a new TCP connection to the server of the
+ * test, timed by libcurl from the end of the name lookup (which is
+ * cached after the first probe) to the end of the connect, which is
+ * one round trip. Nothing is sent over the connection.
+ */
+static void dsp_probe_once(struct dsp_probes *p)
+{
+    double namelookup;
+    double connect;
+    CURLcode c_status;
+
+    ++p->sent;
+    curl_easy_setopt(probe_handle, CURLOPT_URL, dsp_get_url());
+    c_status = curl_easy_perform(probe_handle);
+    namelookup = 0.0;
+    connect = 0.0;
+    if (c_status == CURLE_OK) {
+        curl_easy_getinfo(probe_handle, CURLINFO_NAMELOOKUP_TIME,
+                &namelookup);
+        curl_easy_getinfo(probe_handle, CURLINFO_CONNECT_TIME, &connect);
+    }
+    if ((c_status != CURLE_OK) || (connect <= namelookup)) {
+        ++p->failed;
+        return;
+    }
+
+    p->rtts[p->next] = dsp_sec_to_nsec(connect - namelookup);
+    p->next = ((p->next + 1) % DSP_MAX_PROBES);
+    if (p->count < DSP_MAX_PROBES)
+        ++p->count;
+}
+
+/* probes every `latency_interval' until dsp_stop_probes() says not to */
+static void *dsp_probe_thread(void *data)
+{
+    int rc;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    pthread_mutex_lock(&probe_lock);
+    while (!probe_stopping) {
+        pthread_mutex_unlock(&probe_lock);
+        dsp_probe_once(&loaded_probes);
+        pthread_mutex_lock(&probe_lock);
+
+        deadline.tv_sec += (time_t)(latency_interval / DSP_NSEC_IN_SEC);
+        deadline.tv_nsec += (long)(latency_interval % DSP_NSEC_IN_SEC);
+        if (deadline.tv_nsec >= ((long)DSP_NSEC_IN_SEC)) {
+            deadline.tv_nsec -= ((long)DSP_NSEC_IN_SEC);
+            ++deadline.tv_sec;
+        }
+        rc = 0;
+        while (!probe_stopping && (rc != ETIMEDOUT))
+            rc = pthread_cond_timedwait(&probe_wake, &probe_lock, &deadline);
+    }
+    pthread_mutex_unlock(&probe_lock);
+    return NULL;
+}
+
+/* the idle probes, made before the test while nothing else is going on */
+static void dsp_run_idle_probes(void)
+{
+    unsigned int x;
+    dsp_nsec_t t;
+
+    memset(&idle_probes, 0, sizeof(idle_probes));
+    memset(&loaded_probes, 0, sizeof(loaded_probes));
+    t = dsp_get_time();
+    for (x = 0; (x < DSP_IDLE_PROBES) && !daemon_stopping; ++x) {
+        dsp_probe_once(&idle_probes);
+        t += (DSP_IDLE_PROBE_SPACING_MS * DSP_NSEC_IN_MSEC);
+        dsp_sleep_until(t);
+    }
+}
+
+static dsp_boolean_t dsp_start_probes(void)
+{
+    probe_stopping = DSP_FALSE;
+    return dsp_create_thread(&probe_thread, dsp_probe_thread, NULL);
+}
+
+static void dsp_stop_probes(void)
+{
+    pthread_mutex_lock(&probe_lock);
+    probe_stopping = DSP_TRUE;
+    pthread_cond_signal(&probe_wake);
+    pthread_mutex_unlock(&probe_lock);
+    pthread_join(probe_thread, NULL);
+}
+#endif
+
+/* generated rather than zeros, which some links would compress */
+static void dsp_fill_upload_buffer(void)
+{
+    size_t x;
+    unsigned int r;
+
+    r = (dsp_get_random_uint() | 1);
+    for (x = 0; x < DSP_UPLOAD_BUFFER_SIZE; ++x) {
+        r ^= (r << 13);
+        r ^= (r >> 17);
+        r ^= (r << 5);
+        upload_buffer[x] = (unsigned char)(r >> 24);
+    }
+}
+
+/*
+ * A new multi handle, and with it no connections to reuse. Unless the
+ * streams are to be multiplexed, --streams=N means N connections even
+ * when the server speaks HTTP/2.
+ */
+static void dsp_init_multi(void)
+{
+    multi_handle = curl_multi_init();
+    if (!multi_handle) {
+        dsp_print_error(curl_easy_strerror(CURLE_FAILED_INIT));
+        exit(EXIT_FAILURE);
+    }
+#if LIBCURL_VERSION_NUM >= 0x073100
+    curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING,
+            (multiplex) ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+    curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS,
+            (multiplex) ? 1L : 0L);
+#endif
+}
+
+#ifdef DSP_HAVE_SAVE
+/*
+ * Create the --save file, with O_DIRECT unless the file system won't
+ * have it, make the buffers and start the writer thread.
+ */
+static void dsp_init_save(void)
+{
+    size_t x;
+    void *data;
+
+    save_file.direct = DSP_TRUE;
+    save_file.fd = -1;
+#ifdef O_DIRECT
+    save_file.fd = open(save_path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT,
+            0666);
+#endif
+    if (save_file.fd < 0) {
+        save_file.direct = DSP_FALSE;
+        save_file.fd = open(save_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    save_file.tail_fd = save_file.fd;
+    if ((save_file.fd >= 0) && save_file.direct)
+        save_file.tail_fd = open(save_path, O_WRONLY);
+    if ((save_file.fd < 0) || (save_file.tail_fd < 0)) {
+        dsp_print_error("%s: %s", save_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    save_file.pool_size = (stream_count + DSP_SAVE_SPARE_BUFFERS);
+    save_file.pool = (struct dsp_save_buffer *)calloc(save_file.pool_size,
+            sizeof(struct dsp_save_buffer));
+    if (!save_file.pool) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (x = 0; x < save_file.pool_size; ++x) {
+        errno = posix_memalign(&data, DSP_SAVE_ALIGNMENT,
+                DSP_SAVE_BUFFER_SIZE);
+        if (errno != 0) {
+            dsp_print_error(strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        save_file.pool[x].data = (unsigned char *)data;
+        save_file.pool[x].next = save_file.spare;
+        save_file.spare = &save_file.pool[x];
+    }
+
+    if (!dsp_create_thread(&save_thread, dsp_save_thread, NULL))
+        exit(EXIT_FAILURE);
+}
+
+/*
+ * Queue what the streams have left in their buffers, wait for the
+ * writer thread to get through all of it, then cut the file to what
+ * was received and wait for it to reach the disk. Returns DSP_FALSE,
+ * after saying why, if any of it couldn't be written.
+ */
+static dsp_boolean_t dsp_finish_save(void)
+{
+    int rc;
+    unsigned int x;
+    dsp_nsec_t t;
+    dsp_nsec_t sync_time;
+
+    t = dsp_get_time();
+    for (x = 0; x < stream_count; ++x) {
+        if (!streams[x].save_buffer)
+            continue;
+        dsp_queue_save_buffer(streams[x].save_buffer);
+        streams[x].save_buffer = NULL;
+    }
+
+    pthread_mutex_lock(&save_lock);
+    while (save_file.queue || save_file.writing)
+        pthread_cond_wait(&save_done, &save_lock);
+    rc = save_file.error;
+    pthread_mutex_unlock(&save_lock);
+
+    sync_time = dsp_get_time();
+    if (!rc && (ftruncate(save_file.fd, (off_t)save_file.end) != 0))
+        rc = errno;
+#ifdef HAVE_FDATASYNC
+    if (!rc && (fdatasync(save_file.fd) != 0))
+        rc = errno;
+#else
+    if (!rc && (fsync(save_file.fd) != 0))
+        rc = errno;
+#endif
+    save_file.write_time += (dsp_get_time() - sync_time);
+    save_file.drain_time = (dsp_get_time() - t);
+
+    if (rc) {
+        dsp_print_error("%s: %s", save_path, strerror(rc));
+        return DSP_FALSE;
+    }
+    return DSP_TRUE;
+}
+
+/* let the writer thread finish what is queued and close the file */
+static void dsp_stop_save(void)
+{
+    size_t x;
+
+    pthread_mutex_lock(&save_lock);
+    save_file.stopping = DSP_TRUE;
+    pthread_cond_signal(&save_wake);
+    pthread_mutex_unlock(&save_lock);
+    pthread_join(save_thread, NULL);
+
+    if (save_file.tail_fd != save_file.fd)
+        close(save_file.tail_fd);
+    close(save_file.fd);
+    for (x = 0; x < save_file.pool_size; ++x)
+        free(save_file.pool[x].data);
+    free(save_file.pool);
+    save_file.pool = NULL;
+}
+#endif
+
+/*
+ * Create the streams and set up their easy handles. This is done only
+ * once: the handles are reused by every test and keep their
+ * connections open in the multi handle's cache between tests.
+ */
+static void dsp_init_streams(void)
+{
+    unsigned int x;
+    const char *s;
+
+    s = dsp_check_http_version(http_version);
+    if (s) {
+        dsp_print_error("`--http': %s", s);
+        exit(EXIT_FAILURE);
+    }
+
+    if (upload || duplex) {
+        dsp_fill_upload_buffer();
+        upload_headers = curl_slist_append(NULL, "Expect:");
+        if (!upload_headers) {
+            dsp_print_error(curl_easy_strerror(CURLE_OUT_OF_MEMORY));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* --duplex has as many upload streams as download streams */
+    allocated_streams = (duplex) ? (stream_count * 2) : stream_count;
+    stream_pool = (struct dsp_stream *)calloc(allocated_streams,
+            sizeof(struct dsp_stream));
+    if (!stream_pool) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    streams = stream_pool;
+    test_streams = allocated_streams;
+
+    dsp_init_multi();
+
+    for (x = 0; x < allocated_streams; ++x) {
+        streams[x].id = x;
+        streams[x].sending = (upload || (x >= stream_count));
+        if (mirror_sources > 1)
+            streams[x].url = mirrors[x % mirror_sources].url;
+        if (!dsp_setup_curl(&streams[x]))
+            exit(EXIT_FAILURE);
+    }
+#ifdef DSP_HAVE_SAVE
+    if (save_path)
+        dsp_init_save();
+#endif
+
+    if (!latency_interval)
+        return;
+    probe_handle = curl_easy_init();
+    if (!probe_handle) {
+        dsp_print_error(curl_easy_strerror(CURLE_FAILED_INIT));
+        exit(EXIT_FAILURE);
+    }
+    curl_easy_setopt(probe_handle, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(probe_handle, CURLOPT_FRESH_CONNECT, 1L);
+    curl_easy_setopt(probe_handle, CURLOPT_FORBID_REUSE, 1L);
+    curl_easy_setopt(probe_handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(probe_handle, CURLOPT_CONNECTTIMEOUT_MS,
+            DSP_PROBE_TIMEOUT_MS);
+}
+
+/*
+ * Get every stream and all of the numbers back to where they are
+ * before a test. The series keep the memory they already have. With
+ * `--keep' the temporary files are emptied rather than made again once
+ * a test has written to them, whatever runs the tests back to back.
+ */
+static dsp_boolean_t dsp_reset_test(void)
+{
+    unsigned int x;
+    struct dsp_stream *s;
+
+    start_time = DSP_ZERO_NSEC;
+    end_time = DSP_ZERO_NSEC;
+    stop_time = DSP_ZERO_NSEC;
+    total_bytes = DSP_ZERO_BYTES;
+    most_bytes_per_sec = DSP_ZERO_BYTES;
+    least_bytes_per_sec = DSP_ZERO_BYTES;
+    download_series.count = 0;
+    download_stats.count = 0;
+    download_stats.stride = 1;
+    download_stats.pending = 0;
+    memset(&download_estimate, 0, sizeof(download_estimate));
+    live_buffer.last_t = DSP_ZERO_NSEC;
+    live_buffer.last_bytes = DSP_ZERO_BYTES;
+    duplex_series[0].count = 0;
+    duplex_series[1].count = 0;
+    memset(&client_cost, 0, sizeof(client_cost));
+    stream_count = test_streams;
+#ifdef DSP_HAVE_RANGE_FILE
+    if ((range_file_fd >= 0) && test_ran &&
+            (ftruncate(range_file_fd, 0) != 0)) {
+        dsp_print_error(strerror(errno));
+        return DSP_FALSE;
+    }
+#endif
+
+    for (x = 0; x < test_streams; ++x) {
+        s = &streams[x];
+        s->end_time = DSP_ZERO_NSEC;
+        s->status = CURLE_OK;
+        s->d_total = DSP_ZERO_BYTES;
+        s->d_current = DSP_ZERO_BYTES;
+        s->total_bytes = DSP_ZERO_BYTES;
+        s->most_bytes_per_sec = DSP_ZERO_BYTES;
+        s->least_bytes_per_sec = DSP_ZERO_BYTES;
+        s->series.count = 0;
+        memset(&s->timings, 0, sizeof(s->timings));
+        s->range_pos = DSP_ZERO_BYTES;
+        s->range_end = DSP_ZERO_BYTES;
+        s->range_checked = DSP_FALSE;
+        s->range_done = DSP_FALSE;
+        dsp_hash_reset(&s->hash);
+        s->hashed = DSP_FALSE;
+        if (!s->fp || !test_ran)
+            continue;
+        if (s->temp_file_path)
+            s->fp = freopen(s->temp_file_path, "w+b", s->fp);
+        else
+            s->fp = freopen(streams[0].temp_file_path, "r+b", s->fp);
+        if (!s->fp) {
+            dsp_print_error(strerror(errno));
+            return DSP_FALSE;
+        }
+    }
+    return DSP_TRUE;
+}
+
+/* run one test over the streams, returns DSP_FALSE if it failed */
+static dsp_boolean_t dsp_run_test(void)
+{
+    unsigned int x;
+    dsp_nsec_t cpu_time;
+    dsp_boolean_t probing;
+    CURLcode c_status;
+
+    test_started = time(NULL);
+    if (!dsp_reset_test())
+        return DSP_FALSE;
+    test_ran = DSP_TRUE;
+
+    if (segmented) {
+        /* a --daemon only asks again after a test failed */
+        if (!object_url && !dsp_discover_object())
+            return DSP_FALSE;
+        dsp_assign_segments();
+#ifdef DSP_HAVE_RANGE_FILE
+        if ((range_file_fd >= 0) && !dsp_size_range_file())
+            return DSP_FALSE;
+#endif
+#ifdef DSP_HAVE_SAVE
+        if (save_path)
+            dsp_set_save_size_hint(object_size);
+#endif
+    }
+
+#ifdef DSP_HAVE_THREADS
+    if (latency_interval)
+        dsp_run_idle_probes();
+#endif
+
+    for (x = 0; x < stream_count; ++x) {
+        c_status = curl_easy_setopt(streams[x].cp, CURLOPT_URL,
+                dsp_get_stream_url(&streams[x]));
+        if ((c_status == CURLE_OK) && segmented)
+            c_status = dsp_set_stream_range(&streams[x]);
+        if (c_status != CURLE_OK) {
+            while (x--)
+                curl_multi_remove_handle(multi_handle, streams[x].cp);
+            dsp_print_error(curl_easy_strerror(c_status));
+            return DSP_FALSE;
+        }
+        curl_multi_add_handle(multi_handle, streams[x].cp);
+    }
+
+    probing = DSP_FALSE;
+#ifdef DSP_HAVE_THREADS
+    if (latency_interval)
+        probing = dsp_start_probes();
+#endif
+    cpu_time = dsp_get_cpu_time();
+    start_time = dsp_get_time();
+    c_status = dsp_run_streams(multi_handle);
+    end_time = (stop_time) ? stop_time : dsp_get_time();
+    dsp_clear_progress();
+    if (cpu_time)
+        client_cost.cpu_time = (dsp_get_cpu_time() - cpu_time);
+#ifdef DSP_HAVE_THREADS
+    if (probing)
+        dsp_stop_probes();
+#endif
+    dsp_record_samples(end_time);
+
+    for (x = 0; x < stream_count; ++x) {
+        curl_multi_remove_handle(multi_handle, streams[x].cp);
+        if (streams[x].fp)
+            fflush(streams[x].fp);
+    }
+#ifdef DSP_HAVE_SAVE
+    if (save_path && !dsp_finish_save())
+        return DSP_FALSE;
+#endif
+
+    if (c_status != CURLE_OK) {
+        if (!daemon_stopping)
+            dsp_print_error(curl_easy_strerror(c_status));
+        free(object_url);
+        object_url = NULL;
+        return DSP_FALSE;
+    }
+
+    dsp_series_get_peak_and_lowest(&download_series, &most_bytes_per_sec,
+            &least_bytes_per_sec);
+    for (x = 0; x < stream_count; ++x)
+        dsp_series_get_peak_and_lowest(&streams[x].series,
+                &streams[x].most_bytes_per_sec,
+                &streams[x].least_bytes_per_sec);
+    if (expected_digest_size && !dsp_check_digests())
+        return DSP_FALSE;
+    return DSP_TRUE;
+}
+
+static void dsp_perform(void)
+{
+    dsp_init_streams();
+    if (!dsp_run_test())
+        exit(EXIT_FAILURE);
+    if (live_output)
+        dsp_flush_live_buffer(DSP_TRUE);
+    dsp_show_results();
+}
+
+/* how the sending (or receiving) streams of the test did */
+static void dsp_get_direction(struct dsp_direction *d, dsp_boolean_t sending)
+{
+    unsigned int x;
+    dsp_nsec_t last;
+
+    d->bytes = DSP_ZERO_BYTES;
+    last = DSP_ZERO_NSEC;
+    for (x = 0; x < stream_count; ++x) {
+        if (streams[x].sending != sending)
+            continue;
+        d->bytes += streams[x].total_bytes;
+        if (streams[x].end_time > last)
+            last = streams[x].end_time;
+    }
+    d->elapsed = (last) ? (last - start_time) : DSP_ZERO_NSEC;
+    d->rate = dsp_get_rate(d->bytes, d->elapsed);
+}
+
+/* how much faster (or slower, below 0) a direction was with the other
+   one going, in percent. Returns DSP_FALSE if either rate is unknown */
+static dsp_boolean_t dsp_get_duplex_change(const struct dsp_direction *d,
+                                           double *percent)
+{
+    if ((d->alone_rate <= 0.0) || (d->rate < 0.0))
+        return DSP_FALSE;
+    *percent = (((d->rate / d->alone_rate) - 1.0) * 100.0);
+    return DSP_TRUE;
+}
+
+static void dsp_show_duplex_direction(const struct dsp_direction *d,
+                                      dsp_boolean_t sending)
+{
+    size_t n;
+    double percent;
+    char value[DSP_SPEED_BUFFER_SIZE + 16];
+
+    value[0] = '\0';
+    dsp_format_size(value, DSP_SIZE_BUFFER_SIZE, d->bytes);
+    dsp_show_direction_line(DSP_DUPLEX_DOWN_SIZE_DISPLAY_TAG, value,
+            sending);
+    value[0] = '\0';
+    dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, d->alone_rate);
+    dsp_show_direction_line(DSP_ALONE_DOWN_RATE_DISPLAY_TAG, value,
+            sending);
+    value[0] = '\0';
+    dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE, d->rate);
+    n = strlen(value);
+    if (n && dsp_get_duplex_change(d, &percent))
+        snprintf(value + n, sizeof(value) - n, " (%+.1f%%)", percent);
+    dsp_show_direction_line(DSP_DUPLEX_DOWN_RATE_DISPLAY_TAG, value,
+            sending);
+    value[0] = '\0';
+    if (d->most_bytes_per_sec)
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE,
+                (double)d->most_bytes_per_sec);
+    dsp_show_direction_line(DSP_PEAK_DOWN_RATE_DISPLAY_TAG, value, sending);
+    value[0] = '\0';
+    if (d->least_bytes_per_sec)
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE,
+                (double)d->least_bytes_per_sec);
+    dsp_show_direction_line(DSP_LOWEST_DOWN_RATE_DISPLAY_TAG, value,
+            sending);
+}
+
+static void dsp_write_json_direction(const char *name,
+                                     const struct dsp_direction *d)
+{
+    double percent;
+
+    printf(",\"%s\":{\"bytes\":%llu,\"elapsed_ns\":%llu", name, d->bytes,
+            d->elapsed);
+    dsp_write_json_rate("alone_bytes_per_sec", d->alone_rate);
+    dsp_write_json_rate("duplex_bytes_per_sec", d->rate);
+    if (dsp_get_duplex_change(d, &percent))
+        printf(",\"change_percent\":%.3f", percent);
+    else
+        fputs(",\"change_percent\":null", stdout);
+    dsp_write_json_rate("peak_bytes_per_sec", (d->most_bytes_per_sec) ?
+            ((double)d->most_bytes_per_sec) : -1.0);
+    dsp_write_json_rate("lowest_bytes_per_sec", (d->least_bytes_per_sec) ?
+            ((double)d->least_bytes_per_sec) : -1.0);
+    putchar('}');
+}
+
+static void dsp_write_csv_direction(const struct dsp_direction *d)
+{
+    double percent;
+
+    printf(",%llu,%llu,", d->bytes, d->elapsed);
+    if (d->alone_rate >= 0.0)
+        printf("%.3f", d->alone_rate);
+    putchar(',');
+    if (d->rate >= 0.0)
+        printf("%.3f", d->rate);
+    putchar(',');
+    if (dsp_get_duplex_change(d, &percent))
+        printf("%.3f", percent);
+    putchar(',');
+    if (d->most_bytes_per_sec)
+        printf("%llu", d->most_bytes_per_sec);
+    putchar(',');
+    if (d->least_bytes_per_sec)
+        printf("%llu", d->least_bytes_per_sec);
+}
+
+static void dsp_show_duplex_results(void)
+{
+    char value[DSP_TIME_BUFFER_SIZE];
+    static const char *names[2] = {"download", "upload"};
+
+    if (output_format == DSP_FORMAT_JSON) {
+        fputs("{\"url\":", stdout);
+        dsp_write_json_string(dsp_get_url());
+        fputs(",\"upload_url\":", stdout);
+        dsp_write_json_string(duplex_url);
+        printf(",\"direction\":\"duplex\",\"streams\":%u,\"elapsed_ns\":%llu",
+                allocated_streams / 2, end_time - start_time);
+        dsp_write_json_direction(names[0], &directions[0]);
+        dsp_write_json_direction(names[1], &directions[1]);
+        if (latency_interval) {
+            fputs(",\"latency\":{", stdout);
+            dsp_write_json_probes("idle", &idle_probes);
+            putchar(',');
+            dsp_write_json_probes("loaded", &loaded_probes);
+            putchar('}');
+        }
+        puts("}");
+    } else if (output_format == DSP_FORMAT_CSV) {
+        fputs("url,upload_url,streams,elapsed_ns", stdout);
+        printf(",%s_bytes,%s_elapsed_ns,%s_alone_bytes_per_sec,"
+                "%s_duplex_bytes_per_sec,%s_change_percent,"
+                "%s_peak_bytes_per_sec,%s_lowest_bytes_per_sec",
+                names[0], names[0], names[0], names[0], names[0], names[0],
+                names[0]);
+        printf(",%s_bytes,%s_elapsed_ns,%s_alone_bytes_per_sec,"
+                "%s_duplex_bytes_per_sec,%s_change_percent,"
+                "%s_peak_bytes_per_sec,%s_lowest_bytes_per_sec",
+                names[1], names[1], names[1], names[1], names[1], names[1],
+                names[1]);
+        if (latency_interval) {
+            dsp_write_csv_probes_header("idle");
+            dsp_write_csv_probes_header("loaded");
+        }
+        putchar('\n');
+        dsp_write_csv_string(dsp_get_url());
+        putchar(',');
+        dsp_write_csv_string(duplex_url);
+        printf(",%u,%llu", allocated_streams / 2, end_time - start_time);
+        dsp_write_csv_direction(&directions[0]);
+        dsp_write_csv_direction(&directions[1]);
+        if (latency_interval) {
+            dsp_write_csv_probes(&idle_probes);
+            dsp_write_csv_probes(&loaded_probes);
+        }
+        putchar('\n');
+    } else {
+        value[0] = '\0';
+        dsp_format_time(value, DSP_TIME_BUFFER_SIZE, end_time - start_time);
+        dsp_show_display_line(DSP_DUPLEX_TIME_DISPLAY_TAG, value);
+        dsp_show_duplex_direction(&directions[0], DSP_FALSE);
+        dsp_show_duplex_direction(&directions[1], DSP_TRUE);
+        if (latency_interval)
+            dsp_show_latency();
+    }
+}
+
+/* run the test over `count' of the streams from `first' on */
+static void dsp_run_duplex_phase(unsigned int first, unsigned int count)
+{
+    streams = &stream_pool[first];
+    test_streams = count;
+    if (!dsp_run_test())
+        exit(EXIT_FAILURE);
+}
+
+/*
+ * The download streams on their own, then the upload streams on their
+ * own for as long (or both for --duration), then all of them at once
+ * in the same loop for as long again. The rates of the last test are
+ * compared to those of the first two.
+ */
+static void dsp_run_duplex(void)
+{
+    unsigned int n;
+
+    dsp_init_streams();
+    n = (allocated_streams / 2);
+
+    dsp_run_duplex_phase(0, n);
+    dsp_get_direction(&directions[0], DSP_FALSE);
+    directions[0].alone_rate = directions[0].rate;
+    if (!test_duration)
+        test_duration = ((end_time > start_time) ?
+                (end_time - start_time) : DSP_NSEC_IN_MSEC);
+
+    dsp_run_duplex_phase(n, n);
+    dsp_get_direction(&directions[1], DSP_TRUE);
+    directions[1].alone_rate = directions[1].rate;
+
+    dsp_run_duplex_phase(0, allocated_streams);
+    dsp_get_direction(&directions[0], DSP_FALSE);
+    dsp_get_direction(&directions[1], DSP_TRUE);
+    dsp_series_get_peak_and_lowest(&duplex_series[0],
+            &directions[0].most_bytes_per_sec,
+            &directions[0].least_bytes_per_sec);
+    dsp_series_get_peak_and_lowest(&duplex_series[1],
+            &directions[1].most_bytes_per_sec,
+            &directions[1].least_bytes_per_sec);
+    dsp_show_duplex_results();
+}
+
+static void dsp_handle_stop_signal(int signum)
+{
+    daemon_stopping = 1;
+}
+
+/* a size the way the options take it (`256K'), or `default' if 0 */
+static void dsp_format_option_size(char *buffer, size_t n, dsp_byte_t bytes)
+{
+    if (!bytes)
+        snprintf(buffer, n, "default");
+    else if (!(bytes % DSP_BINARY_GIBI))
+        snprintf(buffer, n, "%lluG", bytes / DSP_BINARY_GIBI);
+    else if (!(bytes % DSP_BINARY_MEBI))
+        snprintf(buffer, n, "%lluM", bytes / DSP_BINARY_MEBI);
+    else if (!(bytes % DSP_BINARY_KIBI))
+        snprintf(buffer, n, "%lluK", bytes / DSP_BINARY_KIBI);
+    else
+        snprintf(buffer, n, "%llu", bytes);
+}
+
+/* the rate a run of a --sweep is judged by: steady if there is one */
+static double dsp_get_sweep_rate(const struct dsp_sweep_result *r)
+{
+    if (!r->succeeded)
+        return -1.0;
+    return (r->steady_bytes_per_sec >= 0.0) ? r->steady_bytes_per_sec :
+        r->average_bytes_per_sec;
+}
+
+static void dsp_show_sweep_header(void)
+{
+    printf("%-4s %-7s %-15s %-7s %-10s %14s %14s\n", "Run", "Buffer",
+            "Rcvbuf", "Nodelay", "Congestion", "Average rate",
+            "Steady rate");
+}
+
+static void dsp_show_sweep_row(size_t run, const struct dsp_sweep_result *r)
+{
+    char buffer[DSP_SIZE_BUFFER_SIZE];
+    char rcvbuf[DSP_SIZE_BUFFER_SIZE * 2];
+    char effective[DSP_SIZE_BUFFER_SIZE];
+    char average[DSP_SPEED_BUFFER_SIZE];
+    char steady[DSP_SPEED_BUFFER_SIZE];
+
+    dsp_format_option_size(buffer, DSP_SIZE_BUFFER_SIZE,
+            r->tuning.buffer_size);
+    dsp_format_option_size(rcvbuf, DSP_SIZE_BUFFER_SIZE, r->tuning.rcvbuf);
+    if (r->tuning.rcvbuf && r->effective_rcvbuf &&
+            (r->effective_rcvbuf != r->tuning.rcvbuf)) {
+        dsp_format_option_size(effective, DSP_SIZE_BUFFER_SIZE,
+                r->effective_rcvbuf);
+        snprintf(rcvbuf + strlen(rcvbuf), sizeof(rcvbuf) - strlen(rcvbuf),
+                " (%s)", effective);
+    }
+    if (r->succeeded) {
+        dsp_format_rate(average, DSP_SPEED_BUFFER_SIZE,
+                r->average_bytes_per_sec);
+        if (r->steady_bytes_per_sec >= 0.0)
+            dsp_format_rate(steady, DSP_SPEED_BUFFER_SIZE,
+                    r->steady_bytes_per_sec);
+        else
+            strcpy(steady, DSP_UNKNOWN_DISPLAY_DATA);
+    } else {
+        strcpy(average, "failed");
+        strcpy(steady, "failed");
+    }
+    printf("%-4lu %-7s %-15s %-7s %-10s %14s %14s\n", (unsigned long)run + 1,
+            buffer, rcvbuf, (r->tuning.nodelay < 0) ? "default" :
+            (r->tuning.nodelay) ? "on" : "off",
+            (r->tuning.congestion) ? r->tuning.congestion : "default",
+            average, steady);
+}
+
+static void dsp_write_json_sweep_run(const struct dsp_sweep_result *r)
+{
+    fputs("{\"buffer_size\":", stdout);
+    if (r->tuning.buffer_size)
+        printf("%llu", r->tuning.buffer_size);
+    else
+        fputs("null", stdout);
+    fputs(",\"rcvbuf\":", stdout);
+    if (r->tuning.rcvbuf)
+        printf("%llu,\"rcvbuf_effective\":%llu", r->tuning.rcvbuf,
+                r->effective_rcvbuf);
+    else
+        fputs("null,\"rcvbuf_effective\":null", stdout);
+    printf(",\"nodelay\":%s,\"congestion\":", (r->tuning.nodelay < 0) ?
+            "null" : (r->tuning.nodelay) ? "true" : "false");
+    if (r->tuning.congestion)
+        dsp_write_json_string(r->tuning.congestion);
+    else
+        fputs("null", stdout);
+    printf(",\"succeeded\":%s,\"bytes\":%llu,\"elapsed_ns\":%llu",
+            (r->succeeded) ? "true" : "false", r->bytes, r->elapsed);
+    dsp_write_json_rate("average_bytes_per_sec", (r->succeeded) ?
+            r->average_bytes_per_sec : -1.0);
+    dsp_write_json_rate("steady_bytes_per_sec", (r->succeeded) ?
+            r->steady_bytes_per_sec : -1.0);
+    putchar('}');
+}
+
+/*
+ * The table of a --sweep. Text rows were shown as the runs finished,
+ * so only the best run is left to show. The JSON and CSV runs leave
+ * out the settings that weren't given (null or empty).
+ */
+static void dsp_show_sweep_results(const struct dsp_sweep_result *results,
+                                   size_t runs,
+                                   size_t best)
+{
+    size_t x;
+    char value[DSP_SPEED_BUFFER_SIZE];
+    const struct dsp_sweep_result *r;
+
+    if (output_format == DSP_FORMAT_JSON) {
+        fputs("{\"url\":", stdout);
+        dsp_write_json_string(dsp_get_url());
+        printf(",\"direction\":\"%s\",\"streams\":%u,\"runs\":[",
+                (upload) ? "upload" : "download", test_streams);
+        for (x = 0; x < runs; ++x) {
+            if (x)
+                putchar(',');
+            dsp_write_json_sweep_run(&results[x]);
+        }
+        fputs("],\"best\":", stdout);
+        if (best < runs)
+            printf("%lu}\n", (unsigned long)best + 1);
+        else
+            puts("null}");
+        return;
+    }
+
+    if (output_format == DSP_FORMAT_CSV) {
+        puts("run,buffer_size,rcvbuf,rcvbuf_effective,nodelay,congestion,"
+                "succeeded,bytes,elapsed_ns,average_bytes_per_sec,"
+                "steady_bytes_per_sec");
+        for (x = 0; x < runs; ++x) {
+            r = &results[x];
+            printf("%lu,", (unsigned long)x + 1);
+            if (r->tuning.buffer_size)
+                printf("%llu", r->tuning.buffer_size);
+            putchar(',');
+            if (r->tuning.rcvbuf)
+                printf("%llu,%llu", r->tuning.rcvbuf, r->effective_rcvbuf);
+            else
+                putchar(',');
+            printf(",%s,%s,%s,%llu,%llu,", (r->tuning.nodelay < 0) ? "" :
+                    (r->tuning.nodelay) ? "on" : "off",
+                    (r->tuning.congestion) ? r->tuning.congestion : "",
+                    (r->succeeded) ? "true" : "false", r->bytes, r->elapsed);
+            if (r->succeeded)
+                printf("%.3f", r->average_bytes_per_sec);
+            putchar(',');
+            if (r->succeeded && (r->steady_bytes_per_sec >= 0.0))
+                printf("%.3f", r->steady_bytes_per_sec);
+            putchar('\n');
+        }
+        return;
+    }
+
+    if (best < runs) {
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE,
+                dsp_get_sweep_rate(&results[best]));
+        printf("\n" DSP_BEST_RUN_DISPLAY_TAG "%lu (%s)\n",
+                (unsigned long)best + 1, value);
+    } else
+        printf("\n" DSP_BEST_RUN_DISPLAY_TAG DSP_UNKNOWN_DISPLAY_DATA "\n");
+}
+
+/*
+ * Run the test once for every combination of --buffer-size, --rcvbuf,
+ * --nodelay and --congestion, each over new connections, and show how
+ * fast each of them went. Interrupting it shows the runs so far.
+ */
+static void dsp_run_sweep(void)
+{
+    size_t x;
+    size_t y;
+    size_t runs;
+    size_t best;
+    dsp_nsec_t since;
+    struct dsp_sweep_result *r;
+    struct dsp_sweep_result *results;
+
+    signal(SIGINT, dsp_handle_stop_signal);
+    signal(SIGTERM, dsp_handle_stop_signal);
+
+    runs = dsp_get_sweep_runs();
+    results = (struct dsp_sweep_result *)calloc(runs,
+            sizeof(struct dsp_sweep_result));
+    if (!results) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    dsp_init_streams();
+    if (output_format == DSP_FORMAT_TEXT)
+        dsp_show_sweep_header();
+
+    best = runs;
+    for (x = 0; (x < runs) && !daemon_stopping; ++x) {
+        r = &results[x];
+        dsp_get_tuning(x, &tuning);
+        for (y = 0; y < allocated_streams; ++y) {
+            if (dsp_setup_tuning(&streams[y]) != CURLE_OK) {
+                dsp_print_error("can't set the buffer size of libcurl");
+                exit(EXIT_FAILURE);
+            }
+        }
+        effective_rcvbuf = DSP_ZERO_BYTES;
+
+        r->succeeded = dsp_run_test();
+        if (daemon_stopping)
+            break;
+        r->tuning = tuning;
+        r->effective_rcvbuf = effective_rcvbuf;
+        r->bytes = total_bytes;
+        r->elapsed = (end_time - start_time);
+        r->average_bytes_per_sec = dsp_get_rate(total_bytes,
+                end_time - start_time);
+        if (!dsp_get_steady_rate(&download_series, &r->steady_bytes_per_sec,
+                    &since))
+            r->steady_bytes_per_sec = -1.0;
+        if (r->succeeded && ((best == runs) || (dsp_get_sweep_rate(r) >
+                        dsp_get_sweep_rate(&results[best]))))
+            best = x;
+        if (output_format == DSP_FORMAT_TEXT) {
+            dsp_show_sweep_row(x, r);
+            fflush(stdout);
+        }
+    }
+
+    dsp_show_sweep_results(results, x, best);
+    free(results);
+}
+
+/* what libcurl says was spoken, e.g. CURLINFO_HTTP_VERSION's answer */
+static const char *dsp_get_http_version_name(long version)
+{
+    switch (version) {
+    case CURL_HTTP_VERSION_1_0:
+        return "HTTP/1.0";
+    case CURL_HTTP_VERSION_1_1:
+        return "HTTP/1.1";
+#if LIBCURL_VERSION_NUM >= 0x073100
+    case CURL_HTTP_VERSION_2_0:
+        return "HTTP/2";
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074200
+    case CURL_HTTP_VERSION_3:
+        return "HTTP/3";
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static void dsp_show_compare_header(void)
+{
+    printf("%-10s %-7s %-5s %-10s %-10s %14s %14s\n", "Protocol", "Streams",
+            "Conns", "Negotiated", "TTFB", "Average rate", "Body rate");
+}
+
+static void dsp_show_compare_row(const struct dsp_compare_result *r)
+{
+    const char *negotiated;
+    char ttfb[DSP_TIME_BUFFER_SIZE];
+    char average[DSP_SPEED_BUFFER_SIZE];
+    char body[DSP_SPEED_BUFFER_SIZE];
+
+    if (r->skipped) {
+        printf("%-10s %-7u %-5s skipped: %s\n", r->label, r->streams, "-",
+                r->skipped);
+        return;
+    }
+    if (!r->succeeded) {
+        printf("%-10s %-7u %-5lu failed\n", r->label, r->streams,
+                r->connections);
+        return;
+    }
+    negotiated = dsp_get_http_version_name(r->negotiated);
+    if (r->first_byte)
+        dsp_format_latency(ttfb, DSP_TIME_BUFFER_SIZE,
+                dsp_nsec_to_sec(r->first_byte));
+    else
+        strcpy(ttfb, DSP_UNKNOWN_DISPLAY_DATA);
+    dsp_format_rate(average, DSP_SPEED_BUFFER_SIZE, r->average_bytes_per_sec);
+    if (r->body_bytes_per_sec >= 0.0)
+        dsp_format_rate(body, DSP_SPEED_BUFFER_SIZE, r->body_bytes_per_sec);
+    else
+        strcpy(body, DSP_UNKNOWN_DISPLAY_DATA);
+    printf("%-10s %-7u %-5lu %-10s %-10s %14s %14s\n", r->label, r->streams,
+            r->connections, (negotiated) ? negotiated :
+            DSP_UNKNOWN_DISPLAY_DATA, ttfb, average, body);
+}
+
+static void dsp_write_json_compare_run(const struct dsp_compare_result *r)
+{
+    const char *negotiated;
+
+    negotiated = dsp_get_http_version_name(r->negotiated);
+    printf("{\"protocol\":\"HTTP/%s\",\"streams\":%u,\"multiplexed\":%s,"
+            "\"skipped\":", (r->version == DSP_HTTP_1_1) ? "1.1" :
+            (r->version == DSP_HTTP_2) ? "2" : "3", r->streams,
+            (r->multiplexed) ? "true" : "false");
+    if (r->skipped)
+        dsp_write_json_string(r->skipped);
+    else
+        fputs("null", stdout);
+    printf(",\"succeeded\":%s,\"negotiated\":",
+            (r->succeeded) ? "true" : "false");
+    if (r->succeeded && negotiated)
+        dsp_write_json_string(negotiated);
+    else
+        fputs("null", stdout);
+    printf(",\"connections\":%lu,\"bytes\":%llu,\"elapsed_ns\":%llu,"
+            "\"ttfb_ns\":", r->connections, r->bytes, r->elapsed);
+    if (r->succeeded && r->first_byte)
+        printf("%llu", r->first_byte);
+    else
+        fputs("null", stdout);
+    dsp_write_json_rate("average_bytes_per_sec", (r->succeeded) ?
+            r->average_bytes_per_sec : -1.0);
+    dsp_write_json_rate("body_bytes_per_sec", (r->succeeded) ?
+            r->body_bytes_per_sec : -1.0);
+    putchar('}');
+}
+
+/*
+ * The table of a --compare-http, the text rows of which were shown as
+ * the runs finished. The best run is the one with the highest average
+ * rate, the time to the first byte being part of it.
+ */
+static void dsp_show_compare_results(const struct dsp_compare_result *results,
+                                     size_t runs,
+                                     size_t best)
+{
+    size_t x;
+    const char *negotiated;
+    char value[DSP_SPEED_BUFFER_SIZE];
+    const struct dsp_compare_result *r;
+
+    if (output_format == DSP_FORMAT_JSON) {
+        fputs("{\"url\":", stdout);
+        dsp_write_json_string(dsp_get_url());
+        printf(",\"direction\":\"%s\",\"runs\":[",
+                (upload) ? "upload" : "download");
+        for (x = 0; x < runs; ++x) {
+            if (x)
+                putchar(',');
+            dsp_write_json_compare_run(&results[x]);
+        }
+        fputs("],\"best\":", stdout);
+        if (best < runs)
+            printf("%lu}\n", (unsigned long)best + 1);
+        else
+            puts("null}");
+        return;
+    }
+
+    if (output_format == DSP_FORMAT_CSV) {
+        puts("run,protocol,streams,multiplexed,skipped,succeeded,negotiated,"
+                "connections,bytes,elapsed_ns,ttfb_ns,average_bytes_per_sec,"
+                "body_bytes_per_sec");
+        for (x = 0; x < runs; ++x) {
+            r = &results[x];
+            negotiated = dsp_get_http_version_name(r->negotiated);
+            printf("%lu,%s,%u,%s,", (unsigned long)x + 1,
+                    (r->version == DSP_HTTP_1_1) ? "HTTP/1.1" :
+                    (r->version == DSP_HTTP_2) ? "HTTP/2" : "HTTP/3",
+                    r->streams, (r->multiplexed) ? "true" : "false");
+            if (r->skipped)
+                fputs(r->skipped, stdout);
+            printf(",%s,%s,%lu,%llu,%llu,", (r->succeeded) ? "true" : "false",
+                    (r->succeeded && negotiated) ? negotiated : "",
+                    r->connections, r->bytes, r->elapsed);
+            if (r->succeeded && r->first_byte)
+                printf("%llu", r->first_byte);
+            putchar(',');
+            if (r->succeeded)
+                printf("%.3f", r->average_bytes_per_sec);
+            putchar(',');
+            if (r->succeeded && (r->body_bytes_per_sec >= 0.0))
+                printf("%.3f", r->body_bytes_per_sec);
+            putchar('\n');
+        }
+        return;
+    }
+
+    if (best < runs) {
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE,
+                results[best].average_bytes_per_sec);
+        printf("\n" DSP_BEST_RUN_DISPLAY_TAG "%s (%s)\n", results[best].label,
+                value);
+    } else
+        printf("\n" DSP_BEST_RUN_DISPLAY_TAG DSP_UNKNOWN_DISPLAY_DATA "\n");
+}
+
+/*
+ * Run the test over HTTP/1.1, over HTTP/2 with the streams on
+ * connections of their own, over HTTP/2 with `compare_streams' streams
+ * multiplexed on one connection and over HTTP/3, one after the other
+ * and each with a new multi handle so that nothing is reused from the
+ * run before. The versions libcurl or the server can't do are skipped.
+ */
+static void dsp_run_http_comparison(void)
+{
+    size_t x;
+    size_t y;
+    size_t runs;
+    size_t best;
+    long n;
+    unsigned int separate_streams;
+    struct dsp_compare_result *r;
+    struct dsp_compare_result results[4];
+
+    signal(SIGINT, dsp_handle_stop_signal);
+    signal(SIGTERM, dsp_handle_stop_signal);
+
+    memset(results, 0, sizeof(results));
+    separate_streams = stream_count;
+    results[0].version = DSP_HTTP_1_1;
+    results[1].version = DSP_HTTP_2;
+    results[2].version = DSP_HTTP_2;
+    results[2].multiplexed = DSP_TRUE;
+    results[3].version = DSP_HTTP_3;
+    runs = (sizeof(results) / sizeof(results[0]));
+    for (x = 0; x < runs; ++x) {
+        r = &results[x];
+        r->streams = (r->multiplexed) ? compare_streams : separate_streams;
+        if (r->multiplexed)
+            snprintf(r->label, sizeof(r->label), "HTTP/2 x%u", r->streams);
+        else
+            snprintf(r->label, sizeof(r->label), "HTTP/%s",
+                    (r->version == DSP_HTTP_1_1) ? "1.1" :
+                    (r->version == DSP_HTTP_2) ? "2" : "3");
+    }
+
+    /* enough streams for the biggest run, each uses the first few */
+    if (compare_streams > stream_count)
+        stream_count = compare_streams;
+    dsp_init_streams();
+    if (output_format == DSP_FORMAT_TEXT)
+        dsp_show_compare_header();
+
+    best = runs;
+    for (x = 0; (x < runs) && !daemon_stopping; ++x) {
+        r = &results[x];
+        r->skipped = dsp_check_http_version(r->version);
+        if (!r->skipped) {
+            http_version = r->version;
+            multiplex = r->multiplexed;
+            for (y = 0; y < allocated_streams; ++y) {
+                if (dsp_setup_http(&streams[y]) != CURLE_OK) {
+                    dsp_print_error("can't set the version of HTTP");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            curl_multi_cleanup(multi_handle);
+            dsp_init_multi();
+            test_streams = r->streams;
+
+            r->succeeded = dsp_run_test();
+            if (daemon_stopping)
+                break;
+            for (y = 0; y < stream_count; ++y) {
+                n = 0;
+                if (curl_easy_getinfo(streams[y].cp, CURLINFO_NUM_CONNECTS,
+                            &n) == CURLE_OK)
+                    r->connections += (unsigned long)n;
+            }
+#if LIBCURL_VERSION_NUM >= 0x073200
+            curl_easy_getinfo(streams[0].cp, CURLINFO_HTTP_VERSION,
+                    &r->negotiated);
+            /* it fell back to HTTP/1.1, which has a run of its own */
+            if (r->succeeded && (r->version == DSP_HTTP_2) &&
+                    (r->negotiated != CURL_HTTP_VERSION_2_0)) {
+                r->succeeded = DSP_FALSE;
+                r->skipped = (dsp_is_https_url(dsp_get_url())) ?
+                    "the server doesn't speak HTTP/2" :
+                    "the server doesn't speak HTTP/2 in the clear";
+            }
+#endif
+            r->bytes = total_bytes;
+            r->elapsed = (end_time - start_time);
+            r->first_byte = dsp_get_first_byte_time();
+            r->average_bytes_per_sec = dsp_get_rate(total_bytes,
+                    end_time - start_time);
+            r->body_bytes_per_sec = dsp_get_body_rate(total_bytes,
+                    end_time - start_time, r->first_byte);
+            if (r->succeeded && ((best == runs) ||
+                        (r->average_bytes_per_sec >
+                         results[best].average_bytes_per_sec)))
+                best = x;
+        }
+        if (output_format == DSP_FORMAT_TEXT) {
+            dsp_show_compare_row(r);
+            fflush(stdout);
+        }
+    }
+
+    dsp_show_compare_results(results, x, best);
+}
+
+static void dsp_show_repeat_header(void)
+{
+    printf("%-4s %-5s %-10s %14s %14s\n", "Run", "Conns", "TTFB",
+            "Average rate", "Body rate");
+}
+
+static void dsp_show_repeat_row(size_t run, const struct dsp_repeat_run *r)
+{
+    char ttfb[DSP_TIME_BUFFER_SIZE];
+    char average[DSP_SPEED_BUFFER_SIZE];
+    char body[DSP_SPEED_BUFFER_SIZE];
+
+    if (!r->succeeded) {
+        printf("%-4lu %-5lu failed\n", (unsigned long)run + 1,
+                r->connections);
+        return;
+    }
+    if (r->first_byte)
+        dsp_format_latency(ttfb, DSP_TIME_BUFFER_SIZE,
+                dsp_nsec_to_sec(r->first_byte));
+    else
+        strcpy(ttfb, DSP_UNKNOWN_DISPLAY_DATA);
+    dsp_format_rate(average, DSP_SPEED_BUFFER_SIZE, r->average_bytes_per_sec);
+    if (r->body_bytes_per_sec >= 0.0)
+        dsp_format_rate(body, DSP_SPEED_BUFFER_SIZE, r->body_bytes_per_sec);
+    else
+        strcpy(body, DSP_UNKNOWN_DISPLAY_DATA);
+    printf("%-4lu %-5lu %-10s %14s %14s\n", (unsigned long)run + 1,
+            r->connections, ttfb, average, body);
+}
+
+/*
+ * Summarize the average rates, the body rates and the times to the
+ * first byte (in seconds) of the successful runs of a --repeat into
+ * `s' in that order, leaving out what isn't known for a run.
+ */
+static void dsp_summarize_runs(const struct dsp_repeat_run *runs,
+                               size_t n,
+                               struct dsp_summary *s)
+{
+    size_t x;
+    size_t counts[3];
+    double *values;
+
+    values = (double *)malloc((n ? n : 1) * 3 * sizeof(double));
+    if (!values) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    counts[0] = counts[1] = counts[2] = 0;
+    for (x = 0; x < n; ++x) {
+        if (!runs[x].succeeded)
+            continue;
+        values[counts[0]++] = runs[x].average_bytes_per_sec;
+        if (runs[x].body_bytes_per_sec >= 0.0)
+            values[n + counts[1]++] = runs[x].body_bytes_per_sec;
+        if (runs[x].first_byte)
+            values[(2 * n) + counts[2]++] =
+                dsp_nsec_to_sec(runs[x].first_byte);
+    }
+    for (x = 0; x < 3; ++x)
+        dsp_summarize(values + (x * n), counts[x], &s[x]);
+    free(values);
+}
+
+/* the mean, the median, or the low or the high end of the confidence
+   interval of `s' for `k' from 0 to 3, or -1 if it isn't known */
+static double dsp_get_summary_value(const struct dsp_summary *s, size_t k)
+{
+    if (!s->n || ((k >= 2) && (s->half_width < 0.0)))
+        return -1.0;
+    if (k == 0)
+        return s->mean;
+    if (k == 1)
+        return s->median;
+    if (k == 2)
+        return (s->mean > s->half_width) ? (s->mean - s->half_width) : 0.0;
+    return (s->mean + s->half_width);
+}
+
+/* a line of the text format for `s', rates unless it is of times */
+static void dsp_show_summary_line(const char *tag,
+                                  const struct dsp_summary *s,
+                                  dsp_boolean_t times)
+{
+    size_t k;
+    char text[4][DSP_SPEED_BUFFER_SIZE];
+    char line[DSP_SPEED_BUFFER_SIZE * 5];
+
+    line[0] = '\0';
+    for (k = 0; s->n && (k < 4); ++k) {
+        if (times)
+            dsp_format_latency(text[k], DSP_SPEED_BUFFER_SIZE,
+                    dsp_get_summary_value(s, k));
+        else
+            dsp_format_rate(text[k], DSP_SPEED_BUFFER_SIZE,
+                    dsp_get_summary_value(s, k));
+    }
+    if (s->n && (s->half_width >= 0.0))
+        snprintf(line, sizeof(line), "%s (median %s, 95%% CI %s to %s)",
+                text[0], text[1], text[2], text[3]);
+    else if (s->n)
+        snprintf(line, sizeof(line), "%s", text[0]);
+    dsp_show_display_line(tag, line);
+}
+
+/* `s' as the JSON object `name', with its values multiplied by `scale' */
+static void dsp_write_json_summary(const char *name,
+                                   const struct dsp_summary *s,
+                                   double scale,
+                                   int precision)
+{
+    size_t k;
+    double v;
+    static const char *keys[4] = {"mean", "median", "ci95_low", "ci95_high"};
+
+    printf(",\"%s\":{\"n\":%lu", name, (unsigned long)s->n);
+    for (k = 0; k < 4; ++k) {
+        v = dsp_get_summary_value(s, k);
+        if (v < 0.0)
+            printf(",\"%s\":null", keys[k]);
+        else
+            printf(",\"%s\":%.*f", keys[k], precision, v * scale);
+    }
+    putchar('}');
+}
+
+/*
+ * How the runs of a --repeat went. Text rows were shown as the runs
+ * finished, so only the summary is left to show. The CSV format puts
+ * the summary in rows of its own after the runs, named in the `run'
+ * column.
+ */
+static void dsp_show_repeat_results(const struct dsp_repeat_run *runs,
+                                    size_t n)
+{
+    size_t x;
+    size_t k;
+    double v;
+    unsigned long failures;
+    unsigned long connections;
+    const struct dsp_repeat_run *r;
+    struct dsp_summary s[3];
+    char value[DSP_SIZE_BUFFER_SIZE];
+    static const char *keys[4] = {"mean", "median", "ci95_low", "ci95_high"};
+
+    failures = 0;
+    connections = 0;
+    for (x = 0; x < n; ++x) {
+        if (!runs[x].succeeded)
+            ++failures;
+        connections += runs[x].connections;
+    }
+    dsp_summarize_runs(runs, n, s);
+
+    if (output_format == DSP_FORMAT_JSON) {
+        fputs("{\"url\":", stdout);
+        dsp_write_json_string(dsp_get_url());
+        printf(",\"direction\":\"%s\",\"streams\":%u,\"fresh\":%s,"
+                "\"runs\":[", (upload) ? "upload" : "download", stream_count,
+                (fresh_connections) ? "true" : "false");
+        for (x = 0; x < n; ++x) {
+            r = &runs[x];
+            printf("%s{\"succeeded\":%s,\"connections\":%lu,\"bytes\":%llu,"
+                    "\"elapsed_ns\":%llu,\"ttfb_ns\":", (x) ? "," : "",
+                    (r->succeeded) ? "true" : "false", r->connections,
+                    r->bytes, r->elapsed);
+            if (r->succeeded && r->first_byte)
+                printf("%llu", r->first_byte);
+            else
+                fputs("null", stdout);
+            dsp_write_json_rate("average_bytes_per_sec", (r->succeeded) ?
+                    r->average_bytes_per_sec : -1.0);
+            dsp_write_json_rate("body_bytes_per_sec", (r->succeeded) ?
+                    r->body_bytes_per_sec : -1.0);
+            putchar('}');
+        }
+        printf("],\"summary\":{\"runs\":%lu,\"failed\":%lu,"
+                "\"connections\":%lu", (unsigned long)n, failures,
+                connections);
+        dsp_write_json_summary("average_bytes_per_sec", &s[0], 1.0, 3);
+        dsp_write_json_summary("body_bytes_per_sec", &s[1], 1.0, 3);
+        dsp_write_json_summary("ttfb_ns", &s[2], (double)DSP_NSEC_IN_SEC, 0);
+        puts("}}");
+        return;
+    }
+
+    if (output_format == DSP_FORMAT_CSV) {
+        puts("run,succeeded,connections,bytes,elapsed_ns,ttfb_ns,"
+                "average_bytes_per_sec,body_bytes_per_sec");
+        for (x = 0; x < n; ++x) {
+            r = &runs[x];
+            printf("%lu,%s,%lu,%llu,%llu,", (unsigned long)x + 1,
+                    (r->succeeded) ? "true" : "false", r->connections,
+                    r->bytes, r->elapsed);
+            if (r->succeeded && r->first_byte)
+                printf("%llu", r->first_byte);
+            putchar(',');
+            if (r->succeeded)
+                printf("%.3f", r->average_bytes_per_sec);
+            putchar(',');
+            if (r->succeeded && (r->body_bytes_per_sec >= 0.0))
+                printf("%.3f", r->body_bytes_per_sec);
+            putchar('\n');
+        }
+        for (k = 0; k < 4; ++k) {
+            printf("%s,,,,,", keys[k]);
+            v = dsp_get_summary_value(&s[2], k);
+            if (v >= 0.0)
+                printf("%.0f", v * DSP_NSEC_IN_SEC);
+            for (x = 0; x < 2; ++x) {
+                putchar(',');
+                v = dsp_get_summary_value(&s[x], k);
+                if (v >= 0.0)
+                    printf("%.3f", v);
+            }
+            putchar('\n');
+        }
+        return;
+    }
+
+    printf("\n" DSP_TESTS_RUN_DISPLAY_TAG "%lu\n", (unsigned long)n);
+    printf(DSP_TESTS_FAILED_DISPLAY_TAG "%lu\n", failures);
+    snprintf(value, DSP_SIZE_BUFFER_SIZE, "%lu", connections);
+    dsp_show_display_line(DSP_CONNECTIONS_DISPLAY_TAG, value);
+    dsp_show_summary_line(DSP_AVERAGE_DOWN_RATE_DISPLAY_TAG, &s[0],
+            DSP_FALSE);
+    dsp_show_summary_line(DSP_BODY_DOWN_RATE_DISPLAY_TAG, &s[1], DSP_FALSE);
+    dsp_show_summary_line(DSP_TTFB_DISPLAY_TAG, &s[2], DSP_TRUE);
+}
+
+/*
+ * Run the test `repeat_count' times with the same streams, which keep
+ * their connections from one run to the next unless --fresh is given,
+ * waiting --pause between the runs, and summarize the runs rather
+ * than showing each of them in full. Interrupting it summarizes the
+ * runs so far.
+ */
+static void dsp_run_repeat(void)
+{
+    size_t x;
+    unsigned int y;
+    long n;
+    struct dsp_repeat_run *r;
+    struct dsp_repeat_run *runs;
+
+    signal(SIGINT, dsp_handle_stop_signal);
+    signal(SIGTERM, dsp_handle_stop_signal);
+
+    runs = (struct dsp_repeat_run *)calloc(repeat_count,
+            sizeof(struct dsp_repeat_run));
+    if (!runs) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    dsp_init_streams();
+    if (output_format == DSP_FORMAT_TEXT)
+        dsp_show_repeat_header();
+
+    for (x = 0; (x < repeat_count) && !daemon_stopping; ++x) {
+        if (x && repeat_pause) {
+            dsp_sleep_until(dsp_get_time() + repeat_pause);
+            if (daemon_stopping)
+                break;
+        }
+        r = &runs[x];
+        r->succeeded = dsp_run_test();
+        if (daemon_stopping)
+            break;
+        for (y = 0; y < stream_count; ++y) {
+            n = 0;
+            if (curl_easy_getinfo(streams[y].cp, CURLINFO_NUM_CONNECTS,
+                        &n) == CURLE_OK)
+                r->connections += (unsigned long)n;
+        }
+        r->bytes = total_bytes;
+        r->elapsed = (end_time - start_time);
+        r->first_byte = dsp_get_first_byte_time();
+        r->average_bytes_per_sec = dsp_get_rate(total_bytes,
+                end_time - start_time);
+        r->body_bytes_per_sec = dsp_get_body_rate(total_bytes,
+                end_time - start_time, r->first_byte);
+        if (output_format == DSP_FORMAT_TEXT) {
+            dsp_show_repeat_row(x, r);
+            fflush(stdout);
+        }
+    }
+
+    dsp_show_repeat_results(runs, x);
+    free(runs);
+}
+
+/* add the outcome of the test that just ran to the history */
+static void dsp_record_result(dsp_boolean_t succeeded)
+{
+    struct dsp_result *r;
+
+    r = &history.results[history.next];
+    r->started = test_started;
+    r->succeeded = succeeded;
+    r->elapsed = (succeeded) ? (end_time - start_time) : DSP_ZERO_NSEC;
+    r->bytes = (succeeded) ? total_bytes : DSP_ZERO_BYTES;
+    r->average_bytes_per_sec = (succeeded) ?
+        dsp_get_rate(total_bytes, end_time - start_time) : -1.0;
+    r->most_bytes_per_sec = (succeeded) ? most_bytes_per_sec : DSP_ZERO_BYTES;
+    r->least_bytes_per_sec = (succeeded) ? least_bytes_per_sec :
+        DSP_ZERO_BYTES;
+
+    history.next = ((history.next + 1) % DSP_HISTORY_SIZE);
+    if (history.count < DSP_HISTORY_SIZE)
+        ++history.count;
+    ++history.runs;
+    if (!succeeded)
+        ++history.failures;
+    history.bytes += r->bytes;
+}
+
+/* the time until the next test, which is `daemon_interval' give
+   or take a random DSP_DAEMON_JITTER of it */
+static dsp_nsec_t dsp_get_jittered_interval(void)
+{
+    double jitter;
+
+    jitter = (((((double)rand()) / ((double)RAND_MAX)) * 2.0) - 1.0) *
+        DSP_DAEMON_JITTER;
+    return (dsp_nsec_t)(((double)daemon_interval) * (1.0 + jitter));
+}
+
+/* sort the average rates of the successful tests in the history
+   into `rates' (which has room for DSP_HISTORY_SIZE) */
+static size_t dsp_get_history_rates(double *rates)
+{
+    size_t x;
+    size_t n;
+
+    for (x = 0, n = 0; x < history.count; ++x) {
+        if (history.results[x].succeeded &&
+                (history.results[x].average_bytes_per_sec >= 0.0))
+            rates[n++] = history.results[x].average_bytes_per_sec;
+    }
+    if (n)
+        qsort(rates, n, sizeof(double), dsp_compare_doubles);
+    return n;
+}
+
+/* how the tests of a --daemon went, shown when it is stopped */
+static void dsp_show_history(void)
+{
+    size_t n;
+    double *rates;
+    char value[DSP_SPEED_BUFFER_SIZE];
+
+    printf("\n" DSP_TESTS_RUN_DISPLAY_TAG "%lu\n", history.runs);
+    printf(DSP_TESTS_FAILED_DISPLAY_TAG "%lu\n", history.failures);
+
+    rates = (double *)malloc(DSP_HISTORY_SIZE * sizeof(double));
+    if (!rates) {
+        dsp_print_error(strerror(errno));
+        return;
+    }
+    n = dsp_get_history_rates(rates);
+    value[0] = '\0';
+    if (n)
+        dsp_format_rate(value, DSP_SPEED_BUFFER_SIZE,
+                dsp_get_percentile(rates, n, 50.0));
+    dsp_show_display_line(DSP_MEDIAN_DOWN_RATE_DISPLAY_TAG, value);
+    free(rates);
+}
+
+#ifdef DSP_HAVE_SOCKETS
+/*
+ * What --metrics serves. The main thread puts together a new copy
+ * after every test and the listener thread only ever takes a copy of
+ * it, both while holding `metrics_lock', so a scrape never has to
+ * wait for (or get in the way of) a test that is running.
+ */
+struct dsp_metrics {
+    unsigned long      runs;
+    unsigned long      failures;
+    dsp_byte_t         bytes;
+    time_t             last_started;
+    dsp_boolean_t      last_succeeded;
+    /* the rest is about the latest test that succeeded */
+    dsp_boolean_t      have_result;
+    time_t             started;
+    dsp_nsec_t         elapsed;
+    dsp_byte_t         result_bytes;
+    double             average;
+    double             body;
+    double             peak;
+    double             lowest;
+    double             steady;
+    double             mean;
+    dsp_boolean_t      have_percentiles;
+    double             percentiles[DSP_N_PERCENTILES];
+    struct dsp_timings timings;
+    /* the idle and the loaded --latency probes of that test */
+    unsigned long      probes[2];
+    unsigned long      probe_failures[2];
+    size_t             rtt_count[2];
+    double             rtts[2][DSP_N_PERCENTILES];
+    /* over the average rates of the tests in the history */
+    size_t             history_count;
+    double             history_percentiles[DSP_N_PERCENTILES];
+};
+
+struct dsp_metrics metrics;
+pthread_mutex_t    metrics_lock   = PTHREAD_MUTEX_INITIALIZER;
+int                metrics_socket = -1;
+
+/* called by the main thread after every test of a --daemon */
+static void dsp_update_metrics(dsp_boolean_t succeeded)
+{
+    size_t x;
+    size_t y;
+    size_t n;
+    dsp_nsec_t t;
+    double stddev;
+    double *rates;
+    const struct dsp_probes *p;
+    struct dsp_metrics m;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    /* only this thread changes `metrics', so it can be read unlocked */
+    m = metrics;
+    m.runs = history.runs;
+    m.failures = history.failures;
+    m.bytes = history.bytes;
+    m.last_started = test_started;
+    m.last_succeeded = succeeded;
+
+    if (succeeded) {
+        m.have_result = DSP_TRUE;
+        m.started = test_started;
+        m.elapsed = (end_time - start_time);
+        m.result_bytes = total_bytes;
+        m.average = dsp_get_rate(total_bytes, end_time - start_time);
+        m.body = dsp_get_body_rate(total_bytes, end_time - start_time,
+                dsp_get_first_byte_time());
+        m.peak = (most_bytes_per_sec) ? ((double)most_bytes_per_sec) : -1.0;
+        m.lowest = (least_bytes_per_sec) ? ((double)least_bytes_per_sec) :
+            -1.0;
+        if (!dsp_get_steady_rate(&download_series, &m.steady, &t))
+            m.steady = -1.0;
+        m.timings = streams[0].timings;
+        for (y = 0; latency_interval && (y < 2); ++y) {
+            p = (y) ? &loaded_probes : &idle_probes;
+            m.probes[y] = p->sent;
+            m.probe_failures[y] = p->failed;
+            m.rtt_count[y] = 0;
+            rates = dsp_probes_get_sorted_rtts(p);
+            if (!rates)
+                continue;
+            m.rtt_count[y] = p->count;
+            for (x = 0; x < DSP_N_PERCENTILES; ++x)
+                m.rtts[y][x] = dsp_get_percentile(rates, p->count,
+                        (double)percentiles[x]);
+            free(rates);
+        }
+        m.mean = -1.0;
+        m.have_percentiles = DSP_FALSE;
+        rates = dsp_stats_get_sorted_rates(&download_stats);
+        if (rates) {
+            dsp_get_mean_and_stddev(rates, download_stats.count, &m.mean,
+                    &stddev);
+            for (x = 0; x < DSP_N_PERCENTILES; ++x)
+                m.percentiles[x] = dsp_get_percentile(rates,
+                        download_stats.count, (double)percentiles[x]);
+            m.have_percentiles = DSP_TRUE;
+            free(rates);
+        }
+    }
+
+    rates = (double *)malloc(DSP_HISTORY_SIZE * sizeof(double));
+    if (rates) {
+        n = dsp_get_history_rates(rates);
+        m.history_count = n;
+        for (x = 0; n && (x < DSP_N_PERCENTILES); ++x)
+            m.history_percentiles[x] = dsp_get_percentile(rates, n,
+                    (double)percentiles[x]);
+        free(rates);
+    }
+
+    pthread_mutex_lock(&metrics_lock);
+    metrics = m;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static void dsp_append_metrics(char *buffer,
+                               size_t *length,
+                               const char *format,
+                               ...)
+{
+    int n;
+    va_list args;
+
+    if (*length >= (DSP_METRICS_BUFFER_SIZE - 1))
+        return;
+    va_start(args, format);
+    n = vsnprintf(buffer + *length, DSP_METRICS_BUFFER_SIZE - *length,
+            format, args);
+    va_end(args);
+    if (n > 0)
+        *length += ((size_t)n);
+    if (*length >= DSP_METRICS_BUFFER_SIZE)
+        *length = (DSP_METRICS_BUFFER_SIZE - 1);
+}
+
+static void dsp_append_metric_header(char *buffer,
+                                     size_t *length,
+                                     const char *name,
+                                     const char *type,
+                                     const char *help)
+{
+    dsp_append_metrics(buffer, length, "# HELP %s %s\n# TYPE %s %s\n",
+            name, help, name, type);
+}
+
+/* a rate that isn't known is left out rather than given as NaN */
+static void dsp_append_rate_metric(char *buffer,
+                                   size_t *length,
+                                   const char *stat,
+                                   double rate)
+{
+    if (rate >= 0.0)
+        dsp_append_metrics(buffer, length,
+                "dsp_rate_bytes_per_second{stat=\"%s\"} %.3f\n", stat, rate);
+}
+
+/* the metrics in the Prometheus text exposition format (0.0.4), in
+   bytes, bytes per second and seconds whatever the other options say */
+static size_t dsp_format_metrics(char *buffer, const struct dsp_metrics *m)
+{
+    size_t x;
+    size_t y;
+    size_t length;
+    static const unsigned int percentiles[DSP_N_PERCENTILES] =
+        DSP_PERCENTILES;
+
+    length = 0;
+    buffer[0] = '\0';
+
+    dsp_append_metric_header(buffer, &length, "dsp_tests_total", "counter",
+            "Tests run since dsp started.");
+    dsp_append_metrics(buffer, &length, "dsp_tests_total %lu\n", m->runs);
+    dsp_append_metric_header(buffer, &length, "dsp_test_failures_total",
+            "counter", "Tests that failed.");
+    dsp_append_metrics(buffer, &length, "dsp_test_failures_total %lu\n",
+            m->failures);
+    dsp_append_metric_header(buffer, &length, "dsp_downloaded_bytes_total",
+            "counter", "Bytes downloaded by all of the tests.");
+    dsp_append_metrics(buffer, &length, "dsp_downloaded_bytes_total %llu\n",
+            m->bytes);
+    if (!m->runs)
+        return length;
+
+    dsp_append_metric_header(buffer, &length, "dsp_last_test_success",
+            "gauge", "Whether the latest test succeeded.");
+    dsp_append_metrics(buffer, &length, "dsp_last_test_success %d\n",
+            (m->last_succeeded) ? 1 : 0);
+    dsp_append_metric_header(buffer, &length,
+            "dsp_last_test_timestamp_seconds", "gauge",
+            "When the latest test started.");
+    dsp_append_metrics(buffer, &length,
+            "dsp_last_test_timestamp_seconds %ld\n", (long)m->last_started);
+    if (!m->have_result)
+        return length;
+
+    dsp_append_metric_header(buffer, &length,
+            "dsp_last_success_timestamp_seconds", "gauge",
+            "When the latest successful test started.");
+    dsp_append_metrics(buffer, &length,
+            "dsp_last_success_timestamp_seconds %ld\n", (long)m->started);
+    dsp_append_metric_header(buffer, &length, "dsp_bytes", "gauge",
+            "Bytes downloaded by the latest successful test.");
+    dsp_append_metrics(buffer, &length, "dsp_bytes %llu\n", m->result_bytes);
+    dsp_append_metric_header(buffer, &length, "dsp_duration_seconds",
+            "gauge", "How long the latest successful test took.");
+    dsp_append_metrics(buffer, &length, "dsp_duration_seconds %.9f\n",
+            dsp_nsec_to_sec(m->elapsed));
+
+    dsp_append_metric_header(buffer, &length, "dsp_rate_bytes_per_second",
+            "gauge", "Download rates of the latest successful test.");
+    dsp_append_rate_metric(buffer, &length, "average", m->average);
+    dsp_append_rate_metric(buffer, &length, "body", m->body);
+    dsp_append_rate_metric(buffer, &length, "peak", m->peak);
+    dsp_append_rate_metric(buffer, &length, "lowest", m->lowest);
+    dsp_append_rate_metric(buffer, &length, "steady", m->steady);
+    dsp_append_rate_metric(buffer, &length, "mean", m->mean);
+
+    if (m->have_percentiles) {
+        dsp_append_metric_header(buffer, &length,
+                "dsp_interval_rate_bytes_per_second", "gauge",
+                "Percentiles of the sampled rates of the latest successful "
+                "test.");
+        for (x = 0; x < DSP_N_PERCENTILES; ++x)
+            dsp_append_metrics(buffer, &length,
+                    "dsp_interval_rate_bytes_per_second{quantile=\"%g\"} "
+                    "%.3f\n", ((double)percentiles[x]) / 100.0,
+                    m->percentiles[x]);
+    }
+
+    dsp_append_metric_header(buffer, &length, "dsp_phase_seconds", "gauge",
+            "libcurl's timing of the first connection of the latest "
+            "successful test, from the start of the transfer.");
+    dsp_append_metrics(buffer, &length,
+            "dsp_phase_seconds{phase=\"namelookup\"} %.6f\n"
+            "dsp_phase_seconds{phase=\"connect\"} %.6f\n"
+            "dsp_phase_seconds{phase=\"appconnect\"} %.6f\n"
+            "dsp_phase_seconds{phase=\"pretransfer\"} %.6f\n"
+            "dsp_phase_seconds{phase=\"starttransfer\"} %.6f\n"
+            "dsp_phase_seconds{phase=\"total\"} %.6f\n",
+            m->timings.namelookup, m->timings.connect, m->timings.appconnect,
+            m->timings.pretransfer, m->timings.starttransfer,
+            m->timings.total);
+
+    if (latency_interval) {
+        dsp_append_metric_header(buffer, &length, "dsp_latency_probes",
+                "gauge", "Round-trip probes made before (idle) and during "
+                "(loaded) the latest successful test.");
+        for (y = 0; y < 2; ++y)
+            dsp_append_metrics(buffer, &length,
+                    "dsp_latency_probes{state=\"%s\"} %lu\n",
+                    (y) ? "loaded" : "idle", m->probes[y]);
+        dsp_append_metric_header(buffer, &length,
+                "dsp_latency_probe_failures", "gauge",
+                "Round-trip probes of the latest successful test that "
+                "failed.");
+        for (y = 0; y < 2; ++y)
+            dsp_append_metrics(buffer, &length,
+                    "dsp_latency_probe_failures{state=\"%s\"} %lu\n",
+                    (y) ? "loaded" : "idle", m->probe_failures[y]);
+        dsp_append_metric_header(buffer, &length, "dsp_latency_seconds",
+                "gauge", "Percentiles of the round-trip times of the "
+                "latest successful test.");
+        for (y = 0; y < 2; ++y) {
+            for (x = 0; m->rtt_count[y] && (x < DSP_N_PERCENTILES); ++x)
+                dsp_append_metrics(buffer, &length,
+                        "dsp_latency_seconds{state=\"%s\",quantile=\"%g\"} "
+                        "%.6f\n", (y) ? "loaded" : "idle",
+                        ((double)percentiles[x]) / 100.0, m->rtts[y][x]);
+        }
+    }
+
+    if (!m->history_count)
+        return length;
+    dsp_append_metric_header(buffer, &length, "dsp_history_tests", "gauge",
+            "Successful tests the history percentiles are taken over.");
+    dsp_append_metrics(buffer, &length, "dsp_history_tests %lu\n",
+            (unsigned long)m->history_count);
+    dsp_append_metric_header(buffer, &length,
+            "dsp_history_rate_bytes_per_second", "gauge",
+            "Percentiles of the average rates of the latest successful "
+            "tests.");
+    for (x = 0; x < DSP_N_PERCENTILES; ++x)
+        dsp_append_metrics(buffer, &length,
+                "dsp_history_rate_bytes_per_second{quantile=\"%g\"} %.3f\n",
+                ((double)percentiles[x]) / 100.0, m->history_percentiles[x]);
+    return length;
+}
+
+static dsp_boolean_t dsp_send_all(int fd, const char *data, size_t n)
+{
+    ssize_t sent;
+
+    while (n) {
+        sent = send(fd, data, n, 0);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return DSP_FALSE;
+        }
+        data += sent;
+        n -= ((size_t)sent);
+    }
+    return DSP_TRUE;
+}
+
+/* answer one scrape: GET /metrics (or /) gets the metrics, anything
+   else is not found */
+static void dsp_serve_metrics(int fd)
+{
+    size_t got;
+    size_t length;
+    ssize_t n;
+    struct dsp_metrics m;
+    struct timeval tv;
+    char header[DSP_METRICS_REQUEST_SIZE];
+    char request[DSP_METRICS_REQUEST_SIZE];
+    static char body[DSP_METRICS_BUFFER_SIZE];
+
+    tv.tv_sec = DSP_METRICS_TIMEOUT_SEC;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv));
+
+    got = 0;
+    request[0] = '\0';
+    while (got < (DSP_METRICS_REQUEST_SIZE - 1)) {
+        n = recv(fd, request + got, DSP_METRICS_REQUEST_SIZE - 1 - got, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        if (n == 0)
+            break;
+        got += ((size_t)n);
+        request[got] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+            break;
+    }
+    if (!got)
+        return;
+
+    if (dsp_does_string_start_with(request, "GET /metrics ") ||
+            dsp_does_string_start_with(request, "GET /metrics?") ||
+            dsp_does_string_start_with(request, "GET / ")) {
+        pthread_mutex_lock(&metrics_lock);
+        m = metrics;
+        pthread_mutex_unlock(&metrics_lock);
+        length = dsp_format_metrics(body, &m);
+        snprintf(header, DSP_METRICS_REQUEST_SIZE,
+                "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %lu\r\n"
+                "Connection: close\r\n\r\n", (unsigned long)length);
+    } else {
+        length = (size_t)snprintf(body, DSP_METRICS_BUFFER_SIZE,
+                "Not Found\n");
+        snprintf(header, DSP_METRICS_REQUEST_SIZE,
+                "HTTP/1.0 404 Not Found\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Length: %lu\r\n"
+                "Connection: close\r\n\r\n", (unsigned long)length);
+    }
+
+    if (dsp_send_all(fd, header, strlen(header)))
+        dsp_send_all(fd, body, length);
+}
+
+/* the listener thread, which serves one scrape at a time */
+static void *dsp_metrics_thread(void *data)
+{
+    int fd;
+
+    for (;;) {
+        fd = accept(metrics_socket, NULL, NULL);
+        if (fd < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+            dsp_print_error("`--metrics' stopped accepting connections (%s)",
+                    strerror(errno));
+            break;
+        }
+        dsp_serve_metrics(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/*
+ * Start listening on `address' ([ADDR:]PORT) given to `option'. ADDR
+ * may be a name or an address, with an IPv6 address in brackets; an
+ * empty ADDR (`:PORT') means all addresses, and no ADDR at all means
+ * `default_host' (all addresses if NULL). Exits if it can't.
+ */
+static int dsp_listen(const char *address,
+                      const char *option,
+                      const char *default_host)
+{
+    int fd;
+    int on;
+    int rc;
+    char *host;
+    char *port;
+    char *copy;
+    struct addrinfo hints;
+    struct addrinfo *ai;
+    struct addrinfo *res;
+
+    copy = strdup(address);
+    if (!copy) {
+        dsp_print_error(strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    port = strrchr(copy, ':');
+    if (port && (!strchr(copy, ']') || (port > strchr(copy, ']')))) {
+        *port++ = '\0';
+        host = copy;
+        if ((*host == '[') && (host[strlen(host) - 1] == ']')) {
+            host[strlen(host) - 1] = '\0';
+            ++host;
+        }
+        if (!*host)
+            host = NULL;
+    } else {
+        host = (char *)default_host;
+        port = copy;
+    }
+    if ((strspn(port, "0123456789") != strlen(port)) || !*port ||
+            (strlen(port) > 5) || (atol(port) < 1) || (atol(port) > 65535)) {
+        dsp_print_error("`%s' is not a valid argument for `%s' (expected "
+                "a port from 1 to 65535)", address, option);
+        free(copy);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = (AI_PASSIVE | AI_NUMERICSERV);
+    rc = getaddrinfo(host, port, &hints, &res);
+    if (rc != 0) {
+        dsp_print_error("`%s' is not a valid argument for `%s' (%s)",
+                address, option, gai_strerror(rc));
+        free(copy);
+        exit(EXIT_FAILURE);
+    }
+    free(copy);
+
+    fd = -1;
+    errno = 0;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&on, sizeof(on));
+        if ((bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) &&
+                (listen(fd, SOMAXCONN) == 0))
+            break;
+        rc = errno;
+        close(fd);
+        errno = rc;
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        dsp_print_error("can't listen on `%s' for `%s' (%s)", address,
+                option, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* a client that hangs up early must not kill the process */
+    signal(SIGPIPE, SIG_IGN);
+    return fd;
+}
+
+/* listen on --metrics=[ADDR:]PORT from a thread of its own */
+static void dsp_start_metrics(void)
+{
+    pthread_t thread;
+
+    metrics_socket = dsp_listen(metrics_address, "--metrics",
+            DSP_DEFAULT_METRICS_ADDRESS);
+    if (!dsp_create_thread(&thread, dsp_metrics_thread, NULL))
+        exit(EXIT_FAILURE);
+    pthread_detach(thread);
+}
+
+/* one connection to --serve and what has been read from it so far */
+struct dsp_connection {
+    int        fd;
+    size_t     pos;
+    size_t     len;
+    dsp_nsec_t paced_since;
+    dsp_byte_t paced_bytes;
+    char       buffer[DSP_SERVE_BUFFER_SIZE + 1];
+};
+
+/* what --serve has done, shown when it is stopped */
+struct {
+    unsigned long connections;
+    unsigned long requests;
+    dsp_byte_t    sent;
+    dsp_byte_t    received;
+} served;
+
+pthread_mutex_t served_lock  = PTHREAD_MUTEX_INITIALIZER;
+int             serve_socket = -1;
+
+/*
+ * With --serve-rate, wait until the `n' bytes just sent or received
+ * would have taken at that rate. The rate is kept over the whole of a
+ * request's body so that sleeping too long once is made up for.
+ */
+static void dsp_serve_pace(struct dsp_connection *c, dsp_byte_t n)
+{
+    c->paced_bytes += n;
+    if (serve_rate)
+        dsp_sleep_until(c->paced_since + (dsp_nsec_t)(DSP_NSEC_IN_SEC *
+                    (((double)c->paced_bytes) / ((double)serve_rate))));
+}
+
+/* the most to send or receive at once: with --serve-rate a short
+   slice of the rate so the pacing stays smooth */
+static size_t dsp_serve_get_slice(void)
+{
+    dsp_byte_t slice;
+
+    slice = ((dsp_byte_t)DSP_SERVE_IOVECS * DSP_UPLOAD_BUFFER_SIZE);
+    if (serve_rate && ((serve_rate / DSP_SERVE_PACE_DIVISOR) < slice))
+        slice = (serve_rate / DSP_SERVE_PACE_DIVISOR);
+    return (slice) ? ((size_t)slice) : 1;
+}
+
+/* read more of the request into the buffer, returns DSP_FALSE on an
+   error, a timeout or the client hanging up */
+static dsp_boolean_t dsp_serve_fill(struct dsp_connection *c)
+{
+    ssize_t n;
+
+    if (c->pos == c->len) {
+        c->pos = 0;
+        c->len = 0;
+    } else if (c->len == DSP_SERVE_BUFFER_SIZE) {
+        memmove(c->buffer, c->buffer + c->pos, c->len - c->pos);
+        c->len -= c->pos;
+        c->pos = 0;
+    }
+    for (;;) {
+        n = recv(c->fd, c->buffer + c->len, DSP_SERVE_BUFFER_SIZE - c->len,
+                0);
+        if ((n < 0) && (errno == EINTR))
+            continue;
+        if (n <= 0)
+            return DSP_FALSE;
+        c->len += ((size_t)n);
+        return DSP_TRUE;
+    }
+}
+
+/*
+ * Take everything up to and including `end' off the buffer into
+ * `out' (as a string of at most `size' - 1 characters). Returns
+ * DSP_FALSE if the client goes away or sends more than that first.
+ */
+static dsp_boolean_t dsp_serve_read_until(struct dsp_connection *c,
+                                          const char *end,
+                                          char *out,
+                                          size_t size)
+{
+    size_t n;
+    char *found;
+
+    for (;;) {
+        c->buffer[c->len] = '\0';
+        found = strstr(c->buffer + c->pos, end);
+        if (found) {
+            n = ((size_t)(found - (c->buffer + c->pos)) + strlen(end));
+            if (n >= size)
+                return DSP_FALSE;
+            memcpy(out, c->buffer + c->pos, n);
+            out[n] = '\0';
+            c->pos += n;
+            return DSP_TRUE;
+        }
+        if (((c->len - c->pos) >= (size - 1)) || !dsp_serve_fill(c))
+            return DSP_FALSE;
+    }
+}
+
+/* read and throw away `n' bytes of a request body */
+static dsp_boolean_t dsp_serve_discard(struct dsp_connection *c,
+                                       dsp_byte_t n)
+{
+    size_t chunk;
+    size_t slice;
+
+    slice = dsp_serve_get_slice();
+    while (n) {
+        if ((c->pos == c->len) && !dsp_serve_fill(c))
+            return DSP_FALSE;
+        chunk = (c->len - c->pos);
+        if (chunk > slice)
+            chunk = slice;
+        if (((dsp_byte_t)chunk) > n)
+            chunk = (size_t)n;
+        c->pos += chunk;
+        n -= ((dsp_byte_t)chunk);
+        pthread_mutex_lock(&served_lock);
+        served.received += ((dsp_byte_t)chunk);
+        pthread_mutex_unlock(&served_lock);
+        dsp_serve_pace(c, (dsp_byte_t)chunk);
+    }
+    return DSP_TRUE;
+}
+
+/* read and throw away a body sent with chunked encoding */
+static dsp_boolean_t dsp_serve_discard_chunks(struct dsp_connection *c)
+{
+    dsp_byte_t n;
+    char line[DSP_SERVE_HEAD_SIZE];
+
+    for (;;) {
+        if (!dsp_serve_read_until(c, "\r\n", line, sizeof(line)))
+            return DSP_FALSE;
+        n = (dsp_byte_t)strtoull(line, NULL, 16);
+        if (!n)
+            break;
+        if (!dsp_serve_discard(c, n) ||
+                !dsp_serve_read_until(c, "\r\n", line, sizeof(line)))
+            return DSP_FALSE;
+    }
+    /* the trailer, if any, ends with an empty line */
+    do {
+        if (!dsp_serve_read_until(c, "\r\n", line, sizeof(line)))
+            return DSP_FALSE;
+    } while (line[0] != '\r');
+    return DSP_TRUE;
+}
+
+/*
+ * Send `header' followed by `length' bytes of the generated file from
+ * `offset' on. The body comes straight out of `upload_buffer' with
+ * writev(), up to DSP_SERVE_IOVECS copies of it per call, so nothing
+ * is copied or generated per request. The byte at any offset is
+ * always the same, so ranges of the file put together match.
+ */
+static dsp_boolean_t dsp_serve_send(struct dsp_connection *c,
+                                    const char *header,
+                                    dsp_byte_t offset,
+                                    dsp_byte_t length)
+{
+    int n_iov;
+    size_t n;
+    size_t pos;
+    size_t slice;
+    size_t header_left;
+    ssize_t sent;
+    struct iovec iov[DSP_SERVE_IOVECS + 1];
+
+    header_left = strlen(header);
+    slice = dsp_serve_get_slice();
+    c->paced_since = dsp_get_time();
+    c->paced_bytes = DSP_ZERO_BYTES;
+
+    while (header_left || length) {
+        n_iov = 0;
+        n = 0;
+        if (header_left) {
+            iov[n_iov].iov_base = (void *)header;
+            iov[n_iov++].iov_len = header_left;
+        }
+        pos = (size_t)(offset % DSP_UPLOAD_BUFFER_SIZE);
+        while ((n_iov <= DSP_SERVE_IOVECS) && (n < slice) &&
+                (((dsp_byte_t)n) < length)) {
+            iov[n_iov].iov_base = (void *)(upload_buffer + pos);
+            iov[n_iov].iov_len = (DSP_UPLOAD_BUFFER_SIZE - pos);
+            if (iov[n_iov].iov_len > (slice - n))
+                iov[n_iov].iov_len = (slice - n);
+            if (((dsp_byte_t)iov[n_iov].iov_len) > (length - n))
+                iov[n_iov].iov_len = (size_t)(length - n);
+            n += iov[n_iov++].iov_len;
+            pos = 0;
+        }
+
+        sent = writev(c->fd, iov, n_iov);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return DSP_FALSE;
+        }
+        if (((size_t)sent) < header_left) {
+            header += sent;
+            header_left -= ((size_t)sent);
+            continue;
+        }
+        sent -= ((ssize_t)header_left);
+        header_left = 0;
+        offset += ((dsp_byte_t)sent);
+        length -= ((dsp_byte_t)sent);
+        pthread_mutex_lock(&served_lock);
+        served.sent += ((dsp_byte_t)sent);
+        pthread_mutex_unlock(&served_lock);
+        dsp_serve_pace(c, (dsp_byte_t)sent);
+    }
+    return DSP_TRUE;
+}
+
+/* the value of header `name' (with its `:') in `head', or NULL */
+static const char *dsp_serve_get_header(const char *head, const char *name)
+{
+    const char *v;
+
+    for (v = strstr(head, "\r\n"); v; v = strstr(v, "\r\n")) {
+        v += 2;
+        if (dsp_does_string_start_with_nocase(v, name)) {
+            v += strlen(name);
+            while ((*v == ' ') || (*v == '\t'))
+                ++v;
+            return v;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Parse a single `bytes=FIRST-LAST', `bytes=FIRST-' or `bytes=-N'
+ * range of a file of `size' bytes. Returns DSP_FALSE if it can't be
+ * satisfied; anything not understood asks for the whole file.
+ */
+static dsp_boolean_t dsp_serve_get_range(const char *range,
+                                         dsp_byte_t size,
+                                         dsp_byte_t *first,
+                                         dsp_byte_t *last)
+{
+    char *end;
+    dsp_byte_t a;
+    dsp_byte_t b;
+
+    *first = DSP_ZERO_BYTES;
+    *last = (size - 1);
+    if (!range || !dsp_does_string_start_with_nocase(range, "bytes=") ||
+            strchr(range, ','))
+        return DSP_TRUE;
+    range += 6;
+
+    if (*range == '-') {
+        b = strtoull(range + 1, &end, 10);
+        if ((end == (range + 1)) || !b)
+            return DSP_FALSE;
+        if (b < size)
+            *first = (size - b);
+        return DSP_TRUE;
+    }
+
+    a = strtoull(range, &end, 10);
+    if ((end == range) || (*end != '-'))
+        return DSP_TRUE;
+    if (a >= size)
+        return DSP_FALSE;
+    *first = a;
+    range = (end + 1);
+    b = strtoull(range, &end, 10);
+    if ((end != range) && (b < *last)) {
+        /* last before first isn't a range, so the whole file is sent */
+        if (b < *first) {
+            *first = DSP_ZERO_BYTES;
+            return DSP_TRUE;
+        }
+        *last = b;
+    }
+    return DSP_TRUE;
+}
+
+/*
+ * Answer one request on `c', returns DSP_FALSE when the connection is
+ * to be closed. GET and HEAD get a generated file, as big as the last
+ * part of the path says (`/100M') or DSP_DEFAULT_SERVE_SIZE, with
+ * ranges. PUT and POST bodies are read and thrown away.
+ */
+static dsp_boolean_t dsp_serve_request(struct dsp_connection *c)
+{
+    dsp_boolean_t keep_alive;
+    dsp_boolean_t is_head;
+    dsp_byte_t size;
+    dsp_byte_t first;
+    dsp_byte_t last;
+    const char *v;
+    char *path;
+    char *end;
+    char head[DSP_SERVE_HEAD_SIZE];
+    char header[DSP_SERVE_HEAD_SIZE];
+
+    if (!dsp_serve_read_until(c, "\r\n\r\n", head, sizeof(head)))
+        return DSP_FALSE;
+    pthread_mutex_lock(&served_lock);
+    ++served.requests;
+    pthread_mutex_unlock(&served_lock);
+
+    v = dsp_serve_get_header(head, "connection:");
+    if (strstr(head, " HTTP/1.0\r\n"))
+        keep_alive = (v && dsp_does_string_start_with_nocase(v,
+                    "keep-alive"));
+    else
+        keep_alive = !(v && dsp_does_string_start_with_nocase(v, "close"));
+
+    if (serve_delay)
+        dsp_sleep_until(dsp_get_time() + serve_delay);
+
+    if (dsp_does_string_start_with(head, "PUT ") ||
+            dsp_does_string_start_with(head, "POST ")) {
+        v = dsp_serve_get_header(head, "expect:");
+        if (v && dsp_does_string_start_with_nocase(v, "100-continue") &&
+                !dsp_serve_send(c, "HTTP/1.1 100 Continue\r\n\r\n", 0, 0))
+            return DSP_FALSE;
+        c->paced_since = dsp_get_time();
+        c->paced_bytes = DSP_ZERO_BYTES;
+        v = dsp_serve_get_header(head, "transfer-encoding:");
+        if (v && dsp_does_string_start_with_nocase(v, "chunked")) {
+            if (!dsp_serve_discard_chunks(c))
+                return DSP_FALSE;
+        } else {
+            v = dsp_serve_get_header(head, "content-length:");
+            if (v && !dsp_serve_discard(c, (dsp_byte_t)strtoull(v, NULL, 10)))
+                return DSP_FALSE;
+        }
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+                "Content-Length: 0\r\n"
+                "Connection: %s\r\n\r\n", (keep_alive) ? "keep-alive" :
+                "close");
+        return (dsp_serve_send(c, header, 0, 0) && keep_alive);
+    }
+
+    is_head = dsp_does_string_start_with(head, "HEAD ");
+    if (!is_head && !dsp_does_string_start_with(head, "GET ")) {
+        dsp_serve_send(c, "HTTP/1.1 405 Method Not Allowed\r\n"
+                "Allow: GET, HEAD, PUT, POST\r\n"
+                "Content-Length: 0\r\n"
+                "Connection: close\r\n\r\n", 0, 0);
+        return DSP_FALSE;
+    }
+
+    size = DSP_DEFAULT_SERVE_SIZE;
+    path = strchr(head, ' ') + 1;
+    end = strpbrk(path, " ?#");
+    if (end) {
+        *end = '\0';
+        path = strrchr(path, '/');
+        if (path && *++path && !dsp_get_size(path, 1, DSP_MAX_UPLOAD_SIZE,
+                    &size))
+            size = DSP_DEFAULT_SERVE_SIZE;
+        *end = ' ';
+    }
+
+    if (!dsp_serve_get_range(dsp_serve_get_header(head, "range:"), size,
+                &first, &last)) {
+        snprintf(header, sizeof(header),
+                "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                "Content-Range: bytes */%llu\r\n"
+                "Content-Length: 0\r\n"
+                "Connection: %s\r\n\r\n", size, (keep_alive) ? "keep-alive" :
+                "close");
+        return (dsp_serve_send(c, header, 0, 0) && keep_alive);
+    }
+
+    if ((first == 0) && (last == (size - 1)))
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/octet-stream\r\n"
+                "Content-Length: %llu\r\n"
+                "Accept-Ranges: bytes\r\n"
+                "Connection: %s\r\n\r\n", size, (keep_alive) ? "keep-alive" :
+                "close");
+    else
+        snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\n"
+                "Content-Type: application/octet-stream\r\n"
+                "Content-Length: %llu\r\n"
+                "Content-Range: bytes %llu-%llu/%llu\r\n"
+                "Accept-Ranges: bytes\r\n"
+                "Connection: %s\r\n\r\n", (last - first) + 1, first, last,
+                size, (keep_alive) ? "keep-alive" : "close");
+    return (dsp_serve_send(c, header, first,
+                (is_head) ? DSP_ZERO_BYTES : ((last - first) + 1)) &&
+            keep_alive);
+}
+
+/* each connection to --serve gets a thread of its own */
+static void *dsp_serve_thread(void *data)
+{
+    struct timeval tv;
+    struct dsp_connection *c;
+
+    c = (struct dsp_connection *)data;
+    tv.tv_sec = DSP_SERVE_TIMEOUT_SEC;
+    tv.tv_usec = 0;
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+    setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv));
+
+    while (!daemon_stopping && dsp_serve_request(c))
+        ;
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+static void *dsp_serve_listener_thread(void *data)
+{
+    int fd;
+    pthread_t thread;
+    struct dsp_connection *c;
+
+    for (;;) {
+        fd = accept(serve_socket, NULL, NULL);
+        if (fd < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+            dsp_print_error("`--serve' stopped accepting connections (%s)",
+                    strerror(errno));
+            break;
+        }
+        c = (struct dsp_connection *)malloc(sizeof(struct dsp_connection));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->pos = 0;
+        c->len = 0;
+        if (!dsp_create_thread(&thread, dsp_serve_thread, (void *)c)) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        pthread_detach(thread);
+        pthread_mutex_lock(&served_lock);
+        ++served.connections;
+        pthread_mutex_unlock(&served_lock);
+    }
+    return NULL;
+}
+
+static void dsp_show_served(void)
+{
+    char value[DSP_SIZE_BUFFER_SIZE];
+
+    pthread_mutex_lock(&served_lock);
+    if (output_format == DSP_FORMAT_JSON)
+        printf("{\"connections\":%lu,\"requests\":%lu,\"sent_bytes\":%llu,"
+                "\"received_bytes\":%llu}\n", served.connections,
+                served.requests, served.sent, served.received);
+    else if (output_format == DSP_FORMAT_CSV)
+        printf("connections,requests,sent_bytes,received_bytes\n"
+                "%lu,%lu,%llu,%llu\n", served.connections, served.requests,
+                served.sent, served.received);
+    else {
+        printf(DSP_CONNECTIONS_DISPLAY_TAG "%lu\n", served.connections);
+        printf(DSP_REQUESTS_DISPLAY_TAG "%lu\n", served.requests);
+        value[0] = '\0';
+        dsp_format_size(value, DSP_SIZE_BUFFER_SIZE, served.sent);
+        dsp_show_display_line(DSP_TOTAL_SENT_DISPLAY_TAG, value);
+        value[0] = '\0';
+        dsp_format_size(value, DSP_SIZE_BUFFER_SIZE, served.received);
+        dsp_show_display_line(DSP_TOTAL_RECEIVED_DISPLAY_TAG, value);
+    }
+    pthread_mutex_unlock(&served_lock);
+}
+
+/*
+ * --serve: be the other end of a test until SIGINT or SIGTERM, which
+ * only the main thread gets and waits for here.
+ */
+static void dsp_run_server(void)
+{
+    pthread_t thread;
+    sigset_t set;
+    sigset_t old_set;
+
+    signal(SIGINT, dsp_handle_stop_signal);
+    signal(SIGTERM, dsp_handle_stop_signal);
+    dsp_fill_upload_buffer();
+    serve_socket = dsp_listen(serve_address, "--serve", NULL);
+    if (!dsp_create_thread(&thread, dsp_serve_listener_thread, NULL))
+        exit(EXIT_FAILURE);
+    pthread_detach(thread);
+
+    if (output_format == DSP_FORMAT_TEXT) {
+        printf("Serving on %s\n", serve_address);
+        fflush(stdout);
+    }
+    /* with the signals blocked between the check and the wait, one that
+       comes in between isn't missed: sigsuspend() returns for it */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    while (!daemon_stopping)
+        sigsuspend(&old_set);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    dsp_show_served();
+}
+#endif
+
+/*
+ * Keep running tests about every `daemon_interval' until SIGINT or
+ * SIGTERM. The schedule is kept from drifting by counting from when
+ * each test was due rather than from when the last one finished, and
+ * a test that overran its slot is followed by the next one right away.
+ */
+static void dsp_run_daemon(void)
+{
+    dsp_boolean_t succeeded;
+    dsp_nsec_t due_time;
+    dsp_nsec_t next_time;
+    struct tm *t;
+    char when[DSP_TIME_BUFFER_SIZE];
+
+    signal(SIGINT, dsp_handle_stop_signal);
+    signal(SIGTERM, dsp_handle_stop_signal);
+    srand(dsp_get_random_uint());
+
+    dsp_init_streams();
+#ifdef DSP_HAVE_SOCKETS
+    if (metrics_address)
+        dsp_start_metrics();
+#endif
+    due_time = dsp_get_time();
+
+    while (!daemon_stopping) {
+        succeeded = dsp_run_test();
+        if (daemon_stopping)
+            break;
+        dsp_record_result(succeeded);
+#ifdef DSP_HAVE_SOCKETS
+        if (metrics_address)
+            dsp_update_metrics(succeeded);
+#endif
+
+        if (succeeded) {
+            if (live_output)
+                dsp_flush_live_buffer(DSP_TRUE);
+            if (output_format == DSP_FORMAT_TEXT) {
+                when[0] = '\0';
+                t = localtime(&test_started);
+                if (t)
+                    strftime(when, DSP_TIME_BUFFER_SIZE, "%Y-%m-%d %H:%M:%S",
+                            t);
+                printf("%sTest %lu (%s)\n", (history.runs > 1) ? "\n" : "",
+                        history.runs, when);
+            }
+            dsp_show_results();
+            fflush(stdout);
+        }
+
+        next_time = (due_time + dsp_get_jittered_interval());
+        due_time += daemon_interval;
+        if (next_time < dsp_get_time()) {
+            due_time = dsp_get_time();
+            next_time = due_time;
+        }
+        dsp_sleep_until(next_time);
+    }
+
+    if (output_format == DSP_FORMAT_TEXT)
+        dsp_show_history();
+}
+
+static void dsp_cleanup(void)
+{
+    unsigned int x;
+    char *path;
+
+#ifdef DSP_HAVE_RANGE_FILE
+    if (range_file_fd >= 0)
+        close(range_file_fd);
+#endif
+    for (x = 0; x < allocated_streams; ++x) {
+        dsp_series_free(&stream_pool[x].series);
+        if (stream_pool[x].cp) {
+            if (multi_handle)
+                curl_multi_remove_handle(multi_handle, stream_pool[x].cp);
+            curl_easy_cleanup(stream_pool[x].cp);
+        }
+        if (stream_pool[x].fp)
+            fclose(stream_pool[x].fp);
+        path = stream_pool[x].temp_file_path;
+        if (!path)
+            continue;
+        if (!DSP_DELETE_FILE(path))
             dsp_print_error("failed to delete temporary download file "
-                    "`%s' (%s)", temp_file_path, strerror(errno));
-        free(temp_file_path);
+                    "`%s' (%s)", path, strerror(errno));
+        free(path);
     }
+#ifdef DSP_HAVE_SAVE
+    if (save_file.pool)
+        dsp_stop_save();
+#endif
+    if (multi_handle)
+        curl_multi_cleanup(multi_handle);
+    if (probe_handle)
+        curl_easy_cleanup(probe_handle);
+    curl_slist_free_all(upload_headers);
+    free(stream_pool);
+    for (x = 0; x < mirror_count; ++x)
+        free(mirrors[x].url);
+    free(object_url);
+    dsp_series_free(&download_series);
+    dsp_series_free(&duplex_series[0]);
+    dsp_series_free(&duplex_series[1]);
+    curl_global_cleanup();
 }
 
 int main(int argc, char **argv)
 {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
     atexit(dsp_cleanup);
     dsp_parse_options(argv);
-    dsp_perform();
+    dsp_init_progress();
+    if (hash_algorithm)
+        dsp_init_hash();
+#ifdef DSP_HAVE_SOCKETS
+    if (serve_address) {
+        dsp_run_server();
+        exit(EXIT_SUCCESS);
+    }
+#endif
+    if (mirror_list)
+        dsp_select_mirrors();
+    if (daemon_interval)
+        dsp_run_daemon();
+    else if (sweep)
+        dsp_run_sweep();
+    else if (compare_streams)
+        dsp_run_http_comparison();
+    else if (repeat_count)
+        dsp_run_repeat();
+    else if (duplex)
+        dsp_run_duplex();
+    else
+        dsp_perform();
     exit(EXIT_SUCCESS);
     return 0; /* for compilers */
 }